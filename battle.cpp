@@ -0,0 +1,47 @@
+#include "battle.h"
+#include "pokemon.h"
+
+// One attack, as in io_fightTrainer(); returns true if the defender fainted
+static bool battle_attack(Pokemon *attacker, Pokemon *defender, rng *r)
+{
+  int move, dam;
+
+  move = attacker->has_move(1) ? rng_below(r, 2) : 0;
+  dam = attacker->get_dam(move, rng_below(r, 16) + 85, defender);
+  if (attacker->get_acc(move) > rng_below(r, 100))
+  {
+    defender->set_hp(-1 * dam);
+  }
+
+  return defender->get_hp() == 0;
+}
+
+battle_result battle_simulate(Pokemon *team0, unsigned size0,
+                              Pokemon *team1, unsigned size1, rng *r)
+{
+  battle_result result;
+  unsigned i0 = 0, i1 = 0;
+
+  for (result.turns = 1; result.turns <= BATTLE_MAX_TURNS; result.turns++)
+  {
+    if (battle_attack(team0 + i0, team1 + i1, r))
+    {
+      if (++i1 == size1)
+      {
+        result.winner = 0;
+        return result;
+      }
+      continue;
+    }
+    if (battle_attack(team1 + i1, team0 + i0, r) && ++i0 == size0)
+    {
+      result.winner = 1;
+      return result;
+    }
+  }
+
+  result.winner = -1;
+  result.turns = BATTLE_MAX_TURNS;
+
+  return result;
+}
@@ -0,0 +1,27 @@
+#ifndef BATTLE_H
+#define BATTLE_H
+
+#include "rng.h"
+
+class Pokemon;
+
+// Battles still going after this many turns are called a draw
+#define BATTLE_MAX_TURNS 1000
+
+struct battle_result
+{
+  // 0 or 1 for the side that won, or -1 for a draw
+  int winner;
+  unsigned turns;
+};
+
+/* Fights team 0 against team 1 without any I/O, by the same rules as  *
+ * the game's battles: every turn, side 0's pokemon uses a random move *
+ * it knows on side 1's, then side 1's strikes back if it's still up.  *
+ * A pokemon that faints is replaced by the next in its team, and a    *
+ * side loses when its team is used up.  All randomness comes from r,  *
+ * and the teams' hp is left where the battle ended.                   */
+battle_result battle_simulate(Pokemon *team0, unsigned size0,
+                              Pokemon *team1, unsigned size1, rng *r);
+
+#endif
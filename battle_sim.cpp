@@ -0,0 +1,422 @@
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "battle.h"
+#include "db_parse.h"
+#include "parallel.h"
+#include "pokemon.h"
+
+/* Plays random battles headlessly with battle_simulate() and reports    *
+ * how they went: win rates, and the distribution of battle lengths.     *
+ * Battles are handed out to the threads in fixed chunks, each drawing   *
+ * from its own stream derived from the seed, so the results depend on   *
+ * the seed alone and not on the number of threads.  With -S, every      *
+ * species instead fights -n battles of its own against random opponents *
+ * and the win rates come out per species, as CSV.  With -P, every pair  *
+ * of the listed species fights -n battles, taking turns on each side,   *
+ * and the result is a matrix of how often each row beats each column.   *
+ *                                                                        *
+ *   battle_sim [-n battles] [-t threads] [-s seed] [-a levels]           *
+ *              [-b levels] [-k team size] [-S] [-P species]              *
+ *                                                                        *
+ * Levels are a range, like 10-20, or a single level.  Species for -P    *
+ * are a comma separated list of identifiers or numbers, or all.         */
+
+// Battles per chunk of work, and per generate_pokemon_batch() call
+#define SIM_CHUNK 4096
+#define SIM_BLOCK 256
+
+struct sim_config
+{
+  unsigned battles;
+  unsigned threads;
+  uint32_t seed;
+  int min_level[2], max_level[2];
+  unsigned team_size;
+};
+
+struct sim_stats
+{
+  // Wins for side 0, side 1, and draws
+  unsigned long long outcome[3];
+  // Battles by number of turns
+  unsigned long long turns[BATTLE_MAX_TURNS + 1];
+};
+
+static void sim_add(sim_stats *to, const sim_stats &from)
+{
+  unsigned i;
+
+  for (i = 0; i < 3; i++)
+  {
+    to->outcome[i] += from.outcome[i];
+  }
+  for (i = 0; i <= BATTLE_MAX_TURNS; i++)
+  {
+    to->turns[i] += from.turns[i];
+  }
+}
+
+static void sim_record(sim_stats *s, battle_result r)
+{
+  s->outcome[r.winner < 0 ? 2 : r.winner]++;
+  s->turns[r.turns]++;
+}
+
+// Random teams against random teams
+static void sim_teams(const sim_config &conf, sim_stats *total)
+{
+  unsigned chunks = (conf.battles + SIM_CHUNK - 1) / SIM_CHUNK;
+  std::mutex lock;
+
+  parallel_for(chunks, conf.threads, [&](unsigned c) {
+    unsigned k = conf.team_size, first, end, i, j, n;
+    std::vector<Pokemon> team[2];
+    sim_stats *s = new sim_stats();
+    rng r;
+
+    rng_derive(&r, conf.seed, c, 0, 0);
+    team[0].resize(SIM_BLOCK * k);
+    team[1].resize(SIM_BLOCK * k);
+
+    end = std::min(conf.battles, (c + 1) * SIM_CHUNK);
+    for (first = c * SIM_CHUNK; first < end; first += n)
+    {
+      n = std::min(end - first, (unsigned)SIM_BLOCK);
+      for (i = 0; i < 2; i++)
+      {
+        generate_pokemon_batch(conf.min_level[i], conf.max_level[i], n * k,
+                               &r, team[i].data());
+      }
+      for (j = 0; j < n; j++)
+      {
+        sim_record(s, battle_simulate(team[0].data() + j * k, k,
+                                      team[1].data() + j * k, k, &r));
+      }
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    sim_add(total, *s);
+    delete s;
+  });
+}
+
+static void sim_print(const sim_config &conf, const sim_stats &s)
+{
+  unsigned long long n, sum, seen;
+  unsigned i, lo, hi;
+  const double pct[] = { 0.5, 0.9, 0.99 };
+
+  n = s.outcome[0] + s.outcome[1] + s.outcome[2];
+  printf("%llu battles, levels %d-%d vs %d-%d, teams of %u, seed %u\n\n",
+         n, conf.min_level[0], conf.max_level[0], conf.min_level[1],
+         conf.max_level[1], conf.team_size, conf.seed);
+  printf("side 0 wins  %6.2f%%\nside 1 wins  %6.2f%%\ndraws        %6.2f%%\n\n",
+         100.0 * s.outcome[0] / n, 100.0 * s.outcome[1] / n,
+         100.0 * s.outcome[2] / n);
+
+  for (sum = 0, i = 1; i <= BATTLE_MAX_TURNS; i++)
+  {
+    sum += s.turns[i] * i;
+  }
+  printf("turns: mean %.2f", (double)sum / n);
+  for (i = 0; i < sizeof(pct) / sizeof(pct[0]); i++)
+  {
+    for (seen = 0, hi = 1; hi < BATTLE_MAX_TURNS; hi++)
+    {
+      if ((seen += s.turns[hi]) >= pct[i] * n)
+      {
+        break;
+      }
+    }
+    printf(", p%g %u", pct[i] * 100, hi);
+  }
+  for (hi = BATTLE_MAX_TURNS; hi > 1 && !s.turns[hi]; hi--)
+    ;
+  printf(", max %u\n\n", hi);
+
+  // Powers of two wide, so the tail stays readable
+  for (lo = 1; lo <= BATTLE_MAX_TURNS; lo = hi + 1)
+  {
+    hi = std::min(lo * 2 - 1, (unsigned)BATTLE_MAX_TURNS);
+    for (seen = 0, i = lo; i <= hi; i++)
+    {
+      seen += s.turns[i];
+    }
+    if (seen)
+    {
+      printf("%4u-%-4u %12llu %6.2f%%\n", lo, hi, seen, 100.0 * seen / n);
+    }
+  }
+}
+
+// Every species, alone, against random single opponents
+static void sim_species(const sim_config &conf)
+{
+  std::vector<sim_stats *> per(num_species + 1);
+  std::vector<unsigned> order;
+  unsigned i;
+
+  parallel_for(num_species, conf.threads, [&](unsigned sp) {
+    std::vector<Pokemon> opponents(SIM_BLOCK);
+    sim_stats *s = new sim_stats();
+    unsigned done, j, n;
+    Pokemon p;
+    rng r;
+
+    rng_derive(&r, conf.seed, sp + 1, 0, 1);
+    for (done = 0; done < conf.battles; done += n)
+    {
+      n = std::min(conf.battles - done, (unsigned)SIM_BLOCK);
+      generate_pokemon_batch(conf.min_level[1], conf.max_level[1], n, &r,
+                             opponents.data());
+      for (j = 0; j < n; j++)
+      {
+        p = Pokemon(sp + 1, rng_below(&r, conf.max_level[0] -
+                                          conf.min_level[0] + 1) +
+                                conf.min_level[0], &r);
+        sim_record(s, battle_simulate(&p, 1, opponents.data() + j, 1, &r));
+      }
+    }
+    per[sp + 1] = s;
+  });
+
+  for (i = 1; i <= num_species; i++)
+  {
+    order.push_back(i);
+  }
+  std::stable_sort(order.begin(), order.end(), [&](unsigned a, unsigned b) {
+    return per[a]->outcome[0] > per[b]->outcome[0];
+  });
+
+  printf("species,identifier,wins,losses,draws,win_rate\n");
+  for (i = 0; i < order.size(); i++)
+  {
+    const sim_stats *s = per[order[i]];
+
+    printf("%u,%s,%llu,%llu,%llu,%.4f\n", order[i],
+           species[order[i]].identifier(), s->outcome[0], s->outcome[1],
+           s->outcome[2], (double)s->outcome[0] / conf.battles);
+  }
+  for (i = 1; i <= num_species; i++)
+  {
+    delete per[i];
+  }
+}
+
+/* Turns -P's list into species rows, or returns false if one of them  *
+ * doesn't exist.                                                      */
+static bool parse_species(const char *list, std::vector<unsigned> *out)
+{
+  std::string name;
+  const char *end;
+  unsigned sp;
+
+  if (!strcmp(list, "all"))
+  {
+    for (sp = 1; sp <= num_species; sp++)
+    {
+      out->push_back(sp);
+    }
+    return true;
+  }
+
+  for (; *list; list = *end ? end + 1 : end)
+  {
+    end = list + strcspn(list, ",");
+    name.assign(list, end);
+    sp = strspn(name.c_str(), "0123456789") == name.size() ?
+         atoi(name.c_str()) : db_find_species(name.c_str());
+    if (!sp || sp > num_species)
+    {
+      fprintf(stderr, "No species %s\n", name.c_str());
+      return false;
+    }
+    out->push_back(sp);
+  }
+
+  return !out->empty();
+}
+
+/* Every listed species, alone, against every other, each at a random  *
+ * level of its own side's range.  Pairs take turns on side 0, so the  *
+ * matrix isn't skewed by which side a species fought from.            */
+static void sim_pairs(const sim_config &conf,
+                      const std::vector<unsigned> &list)
+{
+  unsigned n = list.size(), i, j;
+  // wins[i * n + j] is how often list[i] beat list[j]
+  std::vector<unsigned long long> wins(n * n);
+
+  parallel_for(n * n, conf.threads, [&](unsigned pair) {
+    unsigned a = pair / n, b = pair % n, done, side;
+    unsigned long long won[2] = { 0, 0 };
+    battle_result result;
+    Pokemon p[2];
+    rng r;
+
+    if (a >= b)
+    {
+      return;
+    }
+    rng_derive(&r, conf.seed, list[a], list[b], 2);
+    for (done = 0; done < conf.battles; done++)
+    {
+      // On odd battles a is side 1, with side 1's levels
+      side = done & 1;
+      p[side] = Pokemon(list[a], rng_below(&r, conf.max_level[side] -
+                                               conf.min_level[side] + 1) +
+                                     conf.min_level[side], &r);
+      p[!side] = Pokemon(list[b], rng_below(&r, conf.max_level[!side] -
+                                                conf.min_level[!side] + 1) +
+                                      conf.min_level[!side], &r);
+      result = battle_simulate(&p[0], 1, &p[1], 1, &r);
+      if (result.winner >= 0)
+      {
+        won[result.winner != (int)side]++;
+      }
+    }
+    wins[a * n + b] = won[0];
+    wins[b * n + a] = won[1];
+  });
+
+  printf("species");
+  for (j = 0; j < n; j++)
+  {
+    printf(",%s", species[list[j]].identifier());
+  }
+  printf("\n");
+  for (i = 0; i < n; i++)
+  {
+    printf("%s", species[list[i]].identifier());
+    for (j = 0; j < n; j++)
+    {
+      if (i == j)
+      {
+        printf(",");
+      }
+      else
+      {
+        printf(",%.4f", (double)wins[i * n + j] / conf.battles);
+      }
+    }
+    printf("\n");
+  }
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr,
+          "Usage: %s [-n battles] [-t threads] [-s seed] [-a levels] "
+          "[-b levels] [-k team size] [-S] [-P species]\n"
+          "  -n  battles to play, per species with -S, or per pair with -P\n"
+          "      (default 1000000)\n"
+          "  -t  threads; 0 is one per core (default 0)\n"
+          "  -s  seed (default 0)\n"
+          "  -a  levels of side 0, like 10-20 (default 1-100)\n"
+          "  -b  levels of side 1 (default 1-100)\n"
+          "  -k  pokemon per team, 1 to 6 (default 1)\n"
+          "  -S  every species against random opponents, as CSV\n"
+          "  -P  every pair of these species, like pikachu,eevee or all,\n"
+          "      as a CSV matrix of row over column win rates\n", name);
+  exit(1);
+}
+
+static void parse_levels(const char *s, int *min, int *max,
+                         const char *name)
+{
+  int n = sscanf(s, "%d-%d", min, max);
+
+  if (n == 1)
+  {
+    *max = *min;
+  }
+  if (n < 1 || *min < 1 || *max < *min)
+  {
+    usage(name);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  sim_config conf = { 1000000, 0, 0, { 1, 1 }, { 100, 100 }, 1 };
+  bool per_species = false;
+  const char *pairs = NULL;
+  std::vector<unsigned> list;
+  sim_stats *total;
+  int c;
+
+  while ((c = getopt(argc, argv, "n:t:s:a:b:k:SP:")) != -1)
+  {
+    switch (c)
+    {
+    case 'n':
+      conf.battles = atoi(optarg);
+      break;
+    case 't':
+      conf.threads = atoi(optarg);
+      break;
+    case 's':
+      conf.seed = strtoul(optarg, NULL, 0);
+      break;
+    case 'a':
+      parse_levels(optarg, &conf.min_level[0], &conf.max_level[0], argv[0]);
+      break;
+    case 'b':
+      parse_levels(optarg, &conf.min_level[1], &conf.max_level[1], argv[0]);
+      break;
+    case 'k':
+      conf.team_size = atoi(optarg);
+      break;
+    case 'S':
+      per_species = true;
+      break;
+    case 'P':
+      pairs = optarg;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind != argc || !conf.battles || conf.team_size < 1 ||
+      conf.team_size > 6 || (per_species && pairs))
+  {
+    usage(argv[0]);
+  }
+  if (!conf.threads)
+  {
+    conf.threads = parallel_threads();
+  }
+
+  // Build every species up front, not one at a time in the workers
+  db_conf.precompute = true;
+  db_parse(false);
+
+  if (pairs)
+  {
+    if (!parse_species(pairs, &list))
+    {
+      usage(argv[0]);
+    }
+    sim_pairs(conf, list);
+  }
+  else if (per_species)
+  {
+    sim_species(conf);
+  }
+  else
+  {
+    total = new sim_stats();
+    sim_teams(conf, total);
+    sim_print(conf, *total);
+    delete total;
+  }
+
+  return 0;
+}
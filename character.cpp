@@ -31,7 +31,7 @@ static void move_hiker_func(Character *c, pair_t dest)
   int base;
   int i;
 
-  base = rand() & 0x7;
+  base = game_rand() & 0x7;
 
   dest[dim_x] = c->pos[dim_x];
   dest[dim_y] = c->pos[dim_y];
@@ -61,7 +61,7 @@ static void move_rival_func(Character *c, pair_t dest)
   int base;
   int i;
   
-  base = rand() & 0x7;
+  base = game_rand() & 0x7;
 
   dest[dim_x] = c->pos[dim_x];
   dest[dim_y] = c->pos[dim_y];
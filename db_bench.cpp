@@ -0,0 +1,194 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "db_parse.h"
+
+/* Loads the Pokedex over and over and reports where the time went, *
+ * per CSV and per phase, as a table on stderr and as JSON.  Every   *
+ * run parses the CSVs unless -s is given, in which case the first   *
+ * run writes the snapshot and the rest load from it.                *
+ *                                                                    *
+ *   db_bench [-n runs] [-t threads] [-a] [-s] [-o out.json] <csvs>   */
+
+struct bench_result {
+  std::vector<db_load_stats> runs;
+  long peak_rss_kb;
+};
+
+static void usage(const char *name)
+{
+  fprintf(stderr,
+          "Usage: %s [-n runs] [-t threads] [-a] [-s] [-o out.json] "
+          "<csv directory>\n"
+          "  -n  loads to time (default 20)\n"
+          "  -t  parse threads; 0 is one per core, 1 is serial (default 0)\n"
+          "  -a  keep every pokemon_moves row, not just level-up moves\n"
+          "  -s  load from the snapshot after the first run\n"
+          "  -o  write the JSON there instead of to stdout\n", name);
+  exit(1);
+}
+
+// Best and median of one measurement over all runs
+template <class F>
+static void best_median(const bench_result &r, F get, double *best,
+                        double *median)
+{
+  std::vector<double> v;
+  unsigned i;
+
+  for (i = 0; i < r.runs.size(); i++) {
+    v.push_back(get(r.runs[i]));
+  }
+  std::sort(v.begin(), v.end());
+  *best = v.front();
+  *median = v[v.size() / 2];
+}
+
+static void print_table(const bench_result &r)
+{
+  const db_load_stats &s = r.runs.back();
+  double best, median;
+  unsigned i;
+
+  fprintf(stderr, "%u runs from %s, peak RSS %ld KiB\n\n",
+          (unsigned) r.runs.size(), s.source, r.peak_rss_kb);
+  fprintf(stderr, "%-20s %10s %8s %10s %10s %10s %12s\n", "file", "bytes",
+          "rows", "best ms", "median ms", "MB/s", "rows/s");
+  for (i = 0; i < s.files.size(); i++) {
+    best_median(r, [i](const db_load_stats &x) {
+      return x.files[i].seconds;
+    }, &best, &median);
+    fprintf(stderr, "%-20s %10zu %8u %10.3f %10.3f %10.1f %12.0f\n",
+            s.files[i].name, s.files[i].bytes, s.files[i].rows,
+            best * 1e3, median * 1e3, s.files[i].bytes / best / 1e6,
+            s.files[i].rows / best);
+  }
+  fprintf(stderr, "\n");
+
+#define PHASE(phase)                                                    \
+  best_median(r, [](const db_load_stats &x) { return x.phase; },        \
+              &best, &median);                                          \
+  fprintf(stderr, "%-20s %30.3f %10.3f\n", #phase, best * 1e3, median * 1e3)
+
+  PHASE(map);
+  PHASE(count);
+  PHASE(parse);
+  PHASE(intern);
+  PHASE(index);
+  PHASE(species);
+  PHASE(total);
+
+#undef PHASE
+}
+
+static void print_json(FILE *o, const bench_result &r, unsigned threads)
+{
+  const db_load_stats &s = r.runs.back();
+  double best, median;
+  unsigned i;
+
+  fprintf(o, "{\n  \"source\": \"%s\",\n  \"runs\": %u,\n"
+          "  \"threads\": %u,\n  \"peak_rss_kb\": %ld,\n  \"files\": [\n",
+          s.source, (unsigned) r.runs.size(), threads, r.peak_rss_kb);
+  for (i = 0; i < s.files.size(); i++) {
+    best_median(r, [i](const db_load_stats &x) {
+      return x.files[i].seconds;
+    }, &best, &median);
+    fprintf(o, "    { \"name\": \"%s\", \"bytes\": %zu, \"rows\": %u, "
+            "\"best_s\": %.9f, \"median_s\": %.9f, "
+            "\"bytes_per_s\": %.0f, \"rows_per_s\": %.0f }%s\n",
+            s.files[i].name, s.files[i].bytes, s.files[i].rows,
+            best, median, s.files[i].bytes / best, s.files[i].rows / best,
+            i + 1 < s.files.size() ? "," : "");
+  }
+  fprintf(o, "  ],\n  \"phases\": {\n");
+
+#define PHASE(phase, sep)                                               \
+  best_median(r, [](const db_load_stats &x) { return x.phase; },        \
+              &best, &median);                                          \
+  fprintf(o, "    \"" #phase "\": { \"best_s\": %.9f, \"median_s\": %.9f }" \
+          sep "\n", best, median)
+
+  PHASE(map, ",");
+  PHASE(count, ",");
+  PHASE(parse, ",");
+  PHASE(intern, ",");
+  PHASE(index, ",");
+  PHASE(species, ",");
+  PHASE(total, "");
+
+#undef PHASE
+
+  fprintf(o, "  }\n}\n");
+}
+
+int main(int argc, char *argv[])
+{
+  const char *out = NULL;
+  struct rusage usage_after;
+  unsigned runs = 20, i;
+  bench_result r;
+  FILE *o;
+  int c;
+
+  db_conf.threads = 0;
+  db_conf.snapshot = false;
+  while ((c = getopt(argc, argv, "n:t:aso:")) != -1) {
+    switch (c) {
+    case 'n':
+      runs = atoi(optarg);
+      break;
+    case 't':
+      db_conf.threads = atoi(optarg);
+      break;
+    case 'a':
+      db_conf.move_methods.clear();
+      break;
+    case 's':
+      db_conf.snapshot = true;
+      break;
+    case 'o':
+      out = optarg;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1 || !runs) {
+    usage(argv[0]);
+  }
+
+  db_conf.csv_dir = argv[optind];
+  db_conf.parallel = db_conf.threads != 1;
+
+  for (i = 0; i < runs; i++) {
+    db_parse(false);
+    r.runs.push_back(db_stats);
+  }
+  getrusage(RUSAGE_SELF, &usage_after);
+  r.peak_rss_kb = usage_after.ru_maxrss;
+
+  // The first run of a snapshot bench is the one that parsed
+  if (db_conf.snapshot && runs > 1) {
+    r.runs.erase(r.runs.begin());
+  }
+
+  print_table(r);
+
+  if (!out) {
+    print_json(stdout, r, db_conf.threads);
+  } else if ((o = fopen(out, "w"))) {
+    print_json(o, r, db_conf.threads);
+    fclose(o);
+  } else {
+    perror(out);
+    return 1;
+  }
+
+  return 0;
+}
@@ -1,395 +1,2317 @@
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
+#include <climits>
+#include <cstdint>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/inotify.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
 
 #include "db_parse.h"
+#include "parallel.h"
 
-static char *next_token(char *start, char delim)
+/* A CSV file mapped read-only into memory.  Rows are tokenized in place *
+ * straight out of the mapping; the only bytes copied out are the        *
+ * identifiers, which have to live in the tables anyway.  Files that may *
+ * be rewritten while they are read are copied instead, since a mapping  *
+ * of a file truncated underneath it faults.                             */
+struct csv_file {
+  const char *data;
+  size_t len;
+  bool copied;
+};
+
+/* Read position within a mapped file.  Every field read consumes the *
+ * field and its trailing delimiter (',' or '\n').  Delimiters are     *
+ * located 64 bytes at a time: delims and newlines are bitmaps of the  *
+ * delimiters in the block at blk that haven't been consumed yet.      */
+struct csv_cursor {
+  const char *p;
+  const char *end;
+  const char *blk;
+  uint64_t delims;
+  uint64_t newlines;
+};
+
+#define CSV_BLOCK 64
+
+/* Bitmaps of the ',' and '\n' bytes among the CSV_BLOCK bytes at b.  *
+ * Picked once at startup from the best the CPU supports.             */
+typedef void (*csv_scan_func)(const char *b, uint64_t *delims,
+                              uint64_t *newlines);
+
+static void csv_scan_scalar(const char *b, uint64_t *delims,
+                            uint64_t *newlines)
+{
+  uint64_t d, n;
+  int i;
+
+  for (d = n = 0, i = 0; i < CSV_BLOCK; i++) {
+    d |= (uint64_t) (b[i] == ',' || b[i] == '\n') << i;
+    n |= (uint64_t) (b[i] == '\n') << i;
+  }
+  *delims = d;
+  *newlines = n;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+
+__attribute__((target("sse2")))
+static void csv_scan_sse2(const char *b, uint64_t *delims,
+                          uint64_t *newlines)
+{
+  const __m128i comma = _mm_set1_epi8(','), nl = _mm_set1_epi8('\n');
+  uint64_t d, n;
+  __m128i v, vn;
+  int i;
+
+  for (d = n = 0, i = 0; i < CSV_BLOCK; i += 16) {
+    v = _mm_loadu_si128((const __m128i *) (b + i));
+    vn = _mm_cmpeq_epi8(v, nl);
+    d |= (uint64_t) (uint16_t)
+      _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, comma), vn)) << i;
+    n |= (uint64_t) (uint16_t) _mm_movemask_epi8(vn) << i;
+  }
+  *delims = d;
+  *newlines = n;
+}
+
+__attribute__((target("avx2")))
+static void csv_scan_avx2(const char *b, uint64_t *delims,
+                          uint64_t *newlines)
+{
+  const __m256i comma = _mm256_set1_epi8(','), nl = _mm256_set1_epi8('\n');
+  __m256i lo, hi, lon, hin;
+
+  lo = _mm256_loadu_si256((const __m256i *) b);
+  hi = _mm256_loadu_si256((const __m256i *) (b + 32));
+  lon = _mm256_cmpeq_epi8(lo, nl);
+  hin = _mm256_cmpeq_epi8(hi, nl);
+  *delims = ((uint32_t) _mm256_movemask_epi8(
+               _mm256_or_si256(_mm256_cmpeq_epi8(lo, comma), lon)) |
+             (uint64_t) (uint32_t) _mm256_movemask_epi8(
+               _mm256_or_si256(_mm256_cmpeq_epi8(hi, comma), hin)) << 32);
+  *newlines = ((uint32_t) _mm256_movemask_epi8(lon) |
+               (uint64_t) (uint32_t) _mm256_movemask_epi8(hin) << 32);
+}
+
+static csv_scan_func csv_pick_scan()
+{
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return csv_scan_avx2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return csv_scan_sse2;
+  }
+  return csv_scan_scalar;
+}
+#else
+static csv_scan_func csv_pick_scan()
+{
+  return csv_scan_scalar;
+}
+#endif
+
+static const csv_scan_func csv_scan = csv_pick_scan();
+
+// Fills the bitmaps for the block at c->blk, never reading past c->end
+static void csv_load_block(csv_cursor *c)
+{
+  char tail[CSV_BLOCK];
+
+  if (c->end - c->blk >= CSV_BLOCK) {
+    csv_scan(c->blk, &c->delims, &c->newlines);
+  } else {
+    memset(tail, 0, sizeof (tail));
+    memcpy(tail, c->blk, c->end - c->blk);
+    csv_scan(tail, &c->delims, &c->newlines);
+  }
+}
+
+// Points the cursor at [p, end)
+static void csv_range(csv_cursor *c, const char *p, const char *end)
+{
+  c->p = c->blk = p;
+  c->end = end;
+  c->delims = c->newlines = 0;
+  if (p != end) {
+    csv_load_block(c);
+  }
+}
+
+/* Returns the next unconsumed delimiter (or end) and consumes it; if *
+ * eol, only a newline will do and any commas before it are skipped.  */
+static inline const char *csv_delim(csv_cursor *c, bool eol = false)
+{
+  uint64_t *m = eol ? &c->newlines : &c->delims;
+  const char *d;
+  int i;
+
+  while (!*m) {
+    if (c->end - c->blk <= CSV_BLOCK) {
+      c->delims = c->newlines = 0;
+      return c->end;
+    }
+    c->blk += CSV_BLOCK;
+    csv_load_block(c);
+  }
+
+  i = __builtin_ctzll(*m);
+  d = c->blk + i;
+  // Drop this delimiter and everything before it from both bitmaps
+  c->delims &= ~(((uint64_t) 2 << i) - 1);
+  c->newlines &= c->delims;
+
+  return d;
+}
+
+/* Maps, or if copy reads, the file; returns false, having said why, if *
+ * it can't.                                                            */
+static bool csv_map(csv_file *f, const char *prefix, const char *name,
+                    bool copy)
+{
+  char path[PATH_MAX];
+  struct stat buf;
+  ssize_t n;
+  char *b;
+  void *m;
+  int fd;
+
+  snprintf(path, sizeof (path), "%s%s", prefix, name);
+
+  f->data = NULL;
+  f->len = 0;
+  f->copied = copy;
+
+  if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &buf)) {
+    perror(path);
+    if (fd >= 0) {
+      close(fd);
+    }
+    return false;
+  }
+
+  if (copy) {
+    // Whatever is there as it is read; a file cut short just ends early
+    b = (char *) malloc(buf.st_size + 1);
+    while (f->len < (size_t) buf.st_size &&
+           (n = pread(fd, b + f->len, buf.st_size - f->len, f->len)) > 0) {
+      f->len += n;
+    }
+    f->data = b;
+  } else if ((f->len = buf.st_size)) {
+    if ((m = mmap(NULL, f->len, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+      perror(path);
+      close(fd);
+      f->len = 0;
+      return false;
+    }
+    madvise(m, f->len, MADV_SEQUENTIAL | MADV_WILLNEED);
+    f->data = (const char *) m;
+  }
+
+  close(fd);
+
+  return true;
+}
+
+static void csv_unmap(csv_file *f)
+{
+  if (f->copied) {
+    free((void *) f->data);
+  } else if (f->data) {
+    munmap((void *) f->data, f->len);
+  }
+  f->data = NULL;
+  f->len = 0;
+}
+
+static void csv_next_line(csv_cursor *c)
+{
+  const char *d = csv_delim(c, true);
+
+  c->p = d + (d != c->end);
+}
+
+// Positions a cursor at the first data row, past the header.
+static void csv_begin(csv_cursor *c, const csv_file *f)
+{
+  csv_range(c, f->data, f->data + f->len);
+  csv_next_line(c);
+}
+
+/* Parses the 1 to 8 decimal digits at p without a per-digit loop: the *
+ * digits are loaded as one little-endian word, shifted so the last    *
+ * digit lands in the top byte, and then folded pairwise into 2-, 4-   *
+ * and 8-digit lanes.  Needs 8 readable bytes at p.                    */
+static inline int csv_digits8(const char *p, size_t len)
+{
+  uint64_t v;
+
+  memcpy(&v, p, sizeof (v));
+  // Bytes past the field may borrow, but only into bytes shifted out
+  v = (v - 0x3030303030303030ULL) << (8 * (8 - len));
+  v = ((v * 10) + (v >> 8)) & 0x00ff00ff00ff00ffULL;
+  v = ((v * 100) + (v >> 16)) & 0x0000ffff0000ffffULL;
+  v = ((v * 10000) + (v >> 32)) & 0x00000000ffffffffULL;
+
+  return (int) v;
+}
+
+/* Empty fields yield empty_value, like the "*tmp ? atoi(tmp) : -1" *
+ * idiom.  Fields are assumed to be plain (optionally negative)      *
+ * decimal integers, which is all the pokedex contains.              */
+static int csv_int(csv_cursor *c, int empty_value)
+{
+  const char *p = c->p, *d;
+  size_t len;
+  int neg, v;
+
+  d = csv_delim(c);
+  c->p = d + (d != c->end);
+
+  len = d - p;
+  if (len && p[len - 1] == '\r') {
+    len--;
+  }
+  if (!len) {
+    return empty_value;
+  }
+
+  neg = (*p == '-');
+  p += neg;
+  len -= neg;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  if (len && len <= 8 && c->end - p >= 8) {
+    v = csv_digits8(p, len);
+  } else
+#endif
+  for (v = 0; len; len--, p++) {
+    v = v * 10 + (*p - '0');
+  }
+
+  return neg ? -v : v;
+}
+
+// Skips over a field that the caller doesn't need
+static inline void csv_skip(csv_cursor *c)
+{
+  const char *d = csv_delim(c);
+
+  c->p = d + (d != c->end);
+}
+
+/* Appends the field and a terminating NUL to pool, returning the *
+ * field's offset there.  If eol, the field runs to the end of the  *
+ * line.                                                            */
+static unsigned csv_intern(csv_cursor *c, std::vector<char> *pool,
+                           bool eol = false)
+{
+  const char *p = c->p, *d;
+  unsigned offset;
+  size_t n;
+
+  d = csv_delim(c, eol);
+  c->p = d + (d != c->end);
+
+  n = d - p;
+  if (n && p[n - 1] == '\r') {
+    n--;
+  }
+  offset = pool->size();
+  pool->insert(pool->end(), p, p + n);
+  pool->push_back('\0');
+
+  return offset;
+}
+
+// Rows left at the cursor, found from the newline bitmaps alone
+static unsigned count_rows(csv_cursor c)
+{
+  unsigned n;
+
+  for (n = __builtin_popcountll(c.newlines);
+       c.end - c.blk > CSV_BLOCK;
+       n += __builtin_popcountll(c.newlines)) {
+    c.blk += CSV_BLOCK;
+    csv_load_block(&c);
+  }
+
+  return n + (c.p != c.end && c.end[-1] != '\n');
+}
+
+#ifndef POKEDEX_BUILTIN
+pokemon_db *pokemon;
+move_db *moves;
+pokemon_move_db *pokemon_moves;
+pokemon_species_db *species;
+experience_db *experience;
+pokemon_stats_db *pokemon_stats;
+pokemon_type_db *pokemon_types;
+pokemon_evolution_db *pokemon_evolutions;
+uint8_t (*type_efficacy)[DB_NUM_TYPES + 1];
+unsigned *types;
+char *db_strings;
+unsigned num_pokemon;
+unsigned num_moves;
+unsigned num_pokemon_moves;
+unsigned num_species;
+unsigned num_experience;
+unsigned num_pokemon_stats;
+unsigned num_pokemon_types;
+unsigned num_pokemon_evolutions;
+unsigned num_types;
+pokemon_move_index pokemon_move_idx;
+evolution_index evolution_idx;
+levelup_move *levelup_moves;
+int (*experience_curve)[DB_CURVE_LEVELS];
+unsigned num_growth_rates;
+#endif
+
+/* All of the tables live in a single arena, each at a cache-line     *
+ * aligned offset, in this order.  Tables are sized by counting rows,  *
+ * but pokemon_moves, types and type_efficacy can keep fewer, and the  *
+ * strings aren't known until everything is parsed, so those come      *
+ * last.  Nothing in the arena is a pointer, so the whole thing can be *
+ * written out and mapped back in anywhere as the snapshot.            */
+enum db_table {
+  tbl_pokemon,
+  tbl_moves,
+  tbl_species,
+  tbl_experience,
+  tbl_pokemon_stats,
+  tbl_types,
+  tbl_pokemon_types,
+  tbl_type_efficacy,
+  tbl_pokemon_evolutions,
+  tbl_pokemon_moves,
+  tbl_strings,
+  num_db_tables
+};
+
+static const size_t table_row_size[num_db_tables] = {
+  sizeof (pokemon_db),
+  sizeof (move_db),
+  sizeof (pokemon_species_db),
+  sizeof (experience_db),
+  sizeof (pokemon_stats_db),
+  sizeof (unsigned),
+  sizeof (pokemon_type_db),
+  sizeof (*type_efficacy),
+  sizeof (pokemon_evolution_db),
+  sizeof (pokemon_move_db),
+  sizeof (char)
+};
+
+#define DB_ALIGN(n) (((n) + 63) & ~(size_t) 63)
+
+struct name_index {
+  unsigned mask;
+  std::vector<unsigned> slots;
+};
+
+/* One complete, loaded copy of the database.  The globals in           *
+ * db_parse.h point into the current set; a reload builds a new set off *
+ * to the side and swaps it in whole.                                   */
+struct db_set {
+  char *arena;
+  size_t arena_size;
+  // Set when the arena is part of a mapped snapshot rather than malloc()ed
+  void *mapping;
+  size_t mapping_size;
+  unsigned rows[num_db_tables];
+  size_t offset[num_db_tables];
+
+  pokemon_db *pokemon;
+  move_db *moves;
+  pokemon_species_db *species;
+  experience_db *experience;
+  pokemon_stats_db *pokemon_stats;
+  unsigned *types;
+  pokemon_type_db *pokemon_types;
+  uint8_t (*type_efficacy)[DB_NUM_TYPES + 1];
+  pokemon_evolution_db *pokemon_evolutions;
+  pokemon_move_db *pokemon_moves;
+  char *strings;
+  unsigned num_types;
+
+  pokemon_move_index move_idx;
+  levelup_move *levelup_moves;
+  unsigned levelup_size;
+  // Everything above lives in a read-only shared memory segment
+  bool shared;
+
+  int (*experience_curve)[DB_CURVE_LEVELS];
+  unsigned num_growth_rates;
+  evolution_index evolution_idx;
+
+  // Where the CSVs came from, for the cold columns
+  char *prefix;
+  move_cold_db *moves_cold;
+  pokemon_species_cold_db *species_cold;
+  std::once_flag moves_cold_once, species_cold_once;
+  // Held by threads building species that weren't precomputed
+  std::mutex species_lock;
+
+  name_index species_names, move_names, type_names;
+  std::once_flag species_names_once, move_names_once, type_names_once;
+};
+
+// Lays the tables out for d->rows, plus row 0 in each; returns the size
+static size_t layout_tables(db_set *d)
+{
+  unsigned i;
+  size_t n;
+
+  for (n = 0, i = 0; i < num_db_tables; i++) {
+    d->offset[i] = n;
+    n = DB_ALIGN(n + (d->rows[i] + 1) * table_row_size[i]);
+  }
+
+  return n;
+}
+
+// Points the set's tables into its arena
+static void bind_tables(db_set *d)
+{
+#define BIND(table, id)                                                 \
+  d->table = (decltype (d->table)) (d->arena + d->offset[id])
+
+  BIND(pokemon, tbl_pokemon);
+  BIND(moves, tbl_moves);
+  BIND(species, tbl_species);
+  BIND(experience, tbl_experience);
+  BIND(pokemon_stats, tbl_pokemon_stats);
+  BIND(types, tbl_types);
+  BIND(pokemon_types, tbl_pokemon_types);
+  BIND(type_efficacy, tbl_type_efficacy);
+  BIND(pokemon_evolutions, tbl_pokemon_evolutions);
+  BIND(pokemon_moves, tbl_pokemon_moves);
+  BIND(strings, tbl_strings);
+
+#undef BIND
+
+  d->num_types = d->rows[tbl_types];
+}
+
+static void free_arena(db_set *d)
+{
+  if (d->mapping) {
+    munmap(d->mapping, d->mapping_size);
+  } else {
+    free(d->arena);
+  }
+  d->arena = NULL;
+  d->mapping = NULL;
+  d->arena_size = d->mapping_size = 0;
+}
+
+// Makes room for d->rows, zeroed, discarding the current arena
+static void alloc_arena(db_set *d)
+{
+  free_arena(d);
+  d->arena_size = layout_tables(d);
+  d->arena = (char *) calloc(1, d->arena_size);
+  bind_tables(d);
+}
+
+/* Lays the arena out again after d->rows changed.  Every table but the *
+ * strings must have kept or lost rows, so each one only ever moves     *
+ * down; the strings are left for the caller to fill in.               */
+static void pack_arena(db_set *d)
+{
+  size_t from[num_db_tables];
+  size_t size;
+  unsigned i;
+
+  memcpy(from, d->offset, sizeof (from));
+  size = layout_tables(d);
+  if (size > d->arena_size) {
+    d->arena = (char *) realloc(d->arena, size);
+  }
+  for (i = 0; i < tbl_strings; i++) {
+    memmove(d->arena + d->offset[i], d->arena + from[i],
+            (d->rows[i] + 1) * table_row_size[i]);
+  }
+  if (size < d->arena_size) {
+    d->arena = (char *) realloc(d->arena, size);
+  }
+  d->arena_size = size;
+  bind_tables(d);
+}
+
+static void free_set(db_set *d)
+{
+  if (!d->shared) {
+    free(d->move_idx.offsets);
+    free(d->move_idx.moves);
+    free(d->levelup_moves);
+  }
+  free(d->experience_curve);
+  free(d->evolution_idx.chain_offsets);
+  free(d->evolution_idx.order);
+  free(d->evolution_idx.species);
+  free_arena(d);
+  free(d->prefix);
+  free(d->moves_cold);
+  free(d->species_cold);
+  delete d;
+}
+
+/* Identifiers are parsed into a pool per table, since tables are parsed *
+ * concurrently, and then interned into the arena's strings once all of  *
+ * them are in.                                                          */
+static std::vector<char> parse_strings[num_db_tables];
+
+// FNV-1a
+static uint32_t str_hash(const char *s)
+{
+  uint32_t h = 2166136261U;
+
+  for (; *s; s++) {
+    h = (h ^ (unsigned char) *s) * 16777619U;
+  }
+
+  return h;
+}
+
+/* name_index is an open-addressed hash table of nonzero values, keyed *
+ * by the string that name(value) gives; 0 marks an empty slot.  It is  *
+ * never more than half full.                                           */
+static void name_index_init(name_index *x, unsigned n)
+{
+  for (x->mask = 15; x->mask < 2 * n; x->mask = x->mask * 2 + 1)
+    ;
+  x->slots.assign(x->mask + 1, 0);
+}
+
+// The slot holding s, or the empty slot where it would go
+template <class F>
+static unsigned *name_slot(name_index *x, const char *s, F name)
+{
+  unsigned i;
+
+  for (i = str_hash(s) & x->mask;
+       x->slots[i] && strcmp(name(x->slots[i]), s);
+       i = (i + 1) & x->mask)
+    ;
+
+  return &x->slots[i];
+}
+
+/* Replaces every pool offset in the tables with the offset of the same *
+ * string in strings, which ends up holding each distinct one once.     */
+static void intern_strings(db_set *d, std::vector<char> *strings)
+{
+  name_index x;
+  unsigned i;
+
+  auto name = [&](unsigned v) { return strings->data() + v; };
+  auto intern = [&](unsigned *offset, const std::vector<char> &pool) {
+    const char *s = pool.data() + *offset;
+    unsigned *slot;
+
+    if (!*s) {
+      *offset = 0;
+      return;
+    }
+    if (!*(slot = name_slot(&x, s, name))) {
+      *slot = strings->size();
+      strings->insert(strings->end(), s, s + strlen(s) + 1);
+    }
+    *offset = *slot;
+  };
+
+  strings->assign(1, '\0');
+  name_index_init(&x, (d->rows[tbl_pokemon] + d->rows[tbl_moves] +
+                       d->rows[tbl_species] + d->rows[tbl_types]));
+  for (i = 1; i <= d->rows[tbl_pokemon]; i++) {
+    intern(&d->pokemon[i].name, parse_strings[tbl_pokemon]);
+  }
+  for (i = 1; i <= d->rows[tbl_moves]; i++) {
+    intern(&d->moves[i].name, parse_strings[tbl_moves]);
+  }
+  for (i = 1; i <= d->rows[tbl_species]; i++) {
+    intern(&d->species[i].name, parse_strings[tbl_species]);
+  }
+  for (i = 1; i <= d->rows[tbl_types]; i++) {
+    intern(&d->types[i], parse_strings[tbl_types]);
+  }
+}
+
+#ifdef POKEDEX_BUILTIN
+/* The tables, fully loaded and precomputed, are generated into .rodata *
+ * by pokedex_gen, so there's nothing left to do at startup.  The set   *
+ * has no tables of its own and only carries the name indexes.          */
+static const bool db_builtin = true;
+extern const move_cold_db builtin_moves_cold[];
+extern const pokemon_species_cold_db builtin_species_cold[];
+static db_set builtin_set;
+static db_set *db_cur = &builtin_set;
+#else
+static const bool db_builtin = false;
+static const move_cold_db *const builtin_moves_cold = NULL;
+static const pokemon_species_cold_db *const builtin_species_cold = NULL;
+static db_set *db_cur;
+#endif
+
+static void parse_pokemon(db_set *d, const csv_file *f)
+{
+  csv_cursor c;
+  unsigned i;
+
+  csv_begin(&c, f);
+  for (i = 1; i <= d->rows[tbl_pokemon] && c.p != c.end; i++) {
+    d->pokemon[i].id = csv_int(&c, 0);
+    d->pokemon[i].name = csv_intern(&c, parse_strings + tbl_pokemon);
+    d->pokemon[i].species_id = csv_int(&c, 0);
+    d->pokemon[i].height = csv_int(&c, 0);
+    d->pokemon[i].weight = csv_int(&c, 0);
+    d->pokemon[i].base_experience = csv_int(&c, 0);
+    d->pokemon[i].order = csv_int(&c, 0);
+    d->pokemon[i].is_default = csv_int(&c, 0);
+  }
+}
+
+static void parse_moves(db_set *d, const csv_file *f)
+{
+  csv_cursor c;
+  unsigned i;
+
+  csv_begin(&c, f);
+  for (i = 1; i <= d->rows[tbl_moves] && c.p != c.end; i++) {
+    d->moves[i].id = csv_int(&c, 0);
+    d->moves[i].name = csv_intern(&c, parse_strings + tbl_moves);
+    csv_skip(&c); // generation_id
+    d->moves[i].type_id = csv_int(&c, -1);
+    d->moves[i].power = csv_int(&c, -1);
+    d->moves[i].pp = csv_int(&c, -1);
+    d->moves[i].accuracy = csv_int(&c, -1);
+    d->moves[i].priority = csv_int(&c, -1);
+    csv_skip(&c); // target_id
+    d->moves[i].damage_class_id = csv_int(&c, -1);
+    csv_next_line(&c);
+  }
+}
+
+static void parse_moves_cold(db_set *d, const csv_file *f)
+{
+  csv_cursor c;
+  unsigned i;
+
+  csv_begin(&c, f);
+  for (i = 1; i <= d->rows[tbl_moves] && c.p != c.end; i++) {
+    csv_skip(&c); // id
+    csv_skip(&c); // identifier
+    d->moves_cold[i].generation_id = csv_int(&c, -1);
+    csv_skip(&c); // type_id
+    csv_skip(&c); // power
+    csv_skip(&c); // pp
+    csv_skip(&c); // accuracy
+    csv_skip(&c); // priority
+    d->moves_cold[i].target_id = csv_int(&c, -1);
+    csv_skip(&c); // damage_class_id
+    d->moves_cold[i].effect_id = csv_int(&c, -1);
+    d->moves_cold[i].effect_chance = csv_int(&c, -1);
+    d->moves_cold[i].contest_type_id = csv_int(&c, -1);
+    d->moves_cold[i].contest_effect_id = csv_int(&c, -1);
+    d->moves_cold[i].super_contest_effect_id = csv_int(&c, -1);
+  }
+}
+
+/* Rows of pokemon_moves that fail the ingest filter are dropped as *
+ * they are parsed; these are built from db_conf before parsing.    */
+static std::vector<bool> keep_method, keep_version_group;
+
+static void build_ingest_filter(std::vector<bool> *keep,
+                                const std::vector<int> &ids)
+{
+  unsigned i;
+
+  keep->clear();
+  for (i = 0; i < ids.size(); i++) {
+    if (ids[i] >= 0) {
+      if ((unsigned) ids[i] >= keep->size()) {
+        keep->resize(ids[i] + 1);
+      }
+      (*keep)[ids[i]] = true;
+    }
+  }
+  // A filter that names only invalid ids still has to reject everything
+  if (!ids.empty() && keep->empty()) {
+    keep->push_back(false);
+  }
+}
+
+static inline bool ingest_keep(const std::vector<bool> &keep, int id)
+{
+  return keep.empty() || ((unsigned) id < keep.size() && keep[id]);
+}
+
+/* Parses complete rows from the cursor into pokemon_moves[row...], *
+ * returning how many passed the ingest filter.                     */
+static unsigned parse_pokemon_moves_rows(db_set *d, csv_cursor *c, unsigned row)
+{
+  pokemon_move_db m;
+  unsigned i;
+
+  for (i = row; c->p != c->end; i += (ingest_keep(keep_method,
+                                                  m.pokemon_move_method_id) &&
+                                      ingest_keep(keep_version_group,
+                                                  m.version_group_id))) {
+    m.pokemon_id = csv_int(c, -1);
+    m.version_group_id = csv_int(c, -1);
+    m.move_id = csv_int(c, -1);
+    m.pokemon_move_method_id = csv_int(c, -1);
+    m.level = csv_int(c, -1);
+    m.order = csv_int(c, -1);
+    d->pokemon_moves[i] = m;
+  }
+
+  return i - row;
+}
+
+static void parse_species(db_set *d, const csv_file *f)
+{
+  csv_cursor c;
+  unsigned i;
+
+  csv_begin(&c, f);
+  for (i = 1; i <= d->rows[tbl_species] && c.p != c.end; i++) {
+    d->species[i].id = csv_int(&c, 0);
+    d->species[i].name = csv_intern(&c, parse_strings + tbl_species);
+    csv_skip(&c); // generation_id
+    d->species[i].evolves_from_species_id = csv_int(&c, -1);
+    d->species[i].evolution_chain_id = csv_int(&c, -1);
+    csv_skip(&c); // color_id
+    csv_skip(&c); // shape_id
+    d->species[i].habitat_id = csv_int(&c, -1);
+    d->species[i].gender_rate = csv_int(&c, -1);
+    d->species[i].capture_rate = csv_int(&c, -1);
+    csv_skip(&c); // base_happiness
+    csv_skip(&c); // is_baby
+    csv_skip(&c); // hatch_counter
+    csv_skip(&c); // has_gender_differences
+    d->species[i].growth_rate_id = csv_int(&c, -1);
+    csv_next_line(&c);
+    d->species[i].initialized = false;
+    d->species[i].levelup_offset = 0;
+    d->species[i].num_levelup_moves = 0;
+    d->species[i].base_stat[0] = d->species[i].base_stat[1] =
+      d->species[i].base_stat[2] = d->species[i].base_stat[3] =
+      d->species[i].base_stat[4] = d->species[i].base_stat[5] = 0;
+  }
+}
+
+static void parse_species_cold(db_set *d, const csv_file *f)
+{
+  pokemon_species_cold_db *s;
+  csv_cursor c;
+  unsigned i;
+
+  csv_begin(&c, f);
+  for (i = 1; i <= d->rows[tbl_species] && c.p != c.end; i++) {
+    s = d->species_cold + i;
+    csv_skip(&c); // id
+    csv_skip(&c); // identifier
+    s->generation_id = csv_int(&c, -1);
+    csv_skip(&c); // evolves_from_species_id
+    csv_skip(&c); // evolution_chain_id
+    s->color_id = csv_int(&c, -1);
+    s->shape_id = csv_int(&c, -1);
+    csv_skip(&c); // habitat_id
+    csv_skip(&c); // gender_rate
+    csv_skip(&c); // capture_rate
+    s->base_happiness = csv_int(&c, -1);
+    s->is_baby = csv_int(&c, -1);
+    s->hatch_counter = csv_int(&c, -1);
+    s->has_gender_differences = csv_int(&c, -1);
+    csv_skip(&c); // growth_rate_id
+    s->forms_switchable = csv_int(&c, -1);
+    s->is_legendary = csv_int(&c, -1);
+    s->is_mythical = csv_int(&c, -1);
+    s->order = csv_int(&c, -1);
+    s->conquest_order = csv_int(&c, -1);
+  }
+}
+
+static void parse_experience(db_set *d, const csv_file *f)
+{
+  csv_cursor c;
+  unsigned i;
+
+  csv_begin(&c, f);
+  for (i = 1; i <= d->rows[tbl_experience] && c.p != c.end; i++) {
+    d->experience[i].growth_rate_id = csv_int(&c, 0);
+    d->experience[i].level = csv_int(&c, -1);
+    d->experience[i].experience = csv_int(&c, -1);
+  }
+}
+
+/* Keeps the English name of every real type, leaving num_types at the *
+ * highest id; ids from 10000 up are not real types.                    */
+static void parse_type_names(db_set *d, const csv_file *f)
+{
+  csv_cursor c;
+  unsigned max;
+  int id;
+
+  csv_begin(&c, f);
+  for (max = 0; c.p != c.end; ) {
+    id = csv_int(&c, 0);
+    if (csv_int(&c, 0) == 9 && id > 0 && (unsigned) id <= d->rows[tbl_types] &&
+        id < 10000) {
+      d->types[id] = csv_intern(&c, parse_strings + tbl_types, true);
+      if ((unsigned) id > max) {
+        max = id;
+      }
+    } else {
+      csv_next_line(&c);
+    }
+  }
+  d->num_types = max;
+}
+
+static void parse_pokemon_stats(db_set *d, const csv_file *f)
+{
+  csv_cursor c;
+  unsigned i;
+
+  csv_begin(&c, f);
+  for (i = 1; i <= d->rows[tbl_pokemon_stats] && c.p != c.end; i++) {
+    d->pokemon_stats[i].pokemon_id = csv_int(&c, 0);
+    d->pokemon_stats[i].stat_id = csv_int(&c, -1);
+    d->pokemon_stats[i].base_stat = csv_int(&c, -1);
+    d->pokemon_stats[i].effort = csv_int(&c, -1);
+  }
+}
+
+static void parse_pokemon_types(db_set *d, const csv_file *f)
+{
+  csv_cursor c;
+  unsigned i;
+
+  csv_begin(&c, f);
+  for (i = 1; i <= d->rows[tbl_pokemon_types] && c.p != c.end; i++) {
+    d->pokemon_types[i].pokemon_id = csv_int(&c, 0);
+    d->pokemon_types[i].type_id = csv_int(&c, 0);
+    d->pokemon_types[i].slot = csv_int(&c, 0);
+  }
+}
+
+/* Fills the matrix in, leaving 100 wherever the CSV says nothing.  The *
+ * table was sized by the CSV's lines; it's cut to its real size later. */
+static void parse_type_efficacy(db_set *d, const csv_file *f)
+{
+  unsigned n = std::min(d->rows[tbl_type_efficacy], (unsigned) DB_NUM_TYPES);
+  unsigned a, t;
+  csv_cursor c;
+  int factor;
+
+  memset(d->type_efficacy, 100, (n + 1) * sizeof (*d->type_efficacy));
+  csv_begin(&c, f);
+  while (c.p != c.end) {
+    a = csv_int(&c, 0);
+    t = csv_int(&c, 0);
+    factor = csv_int(&c, 100);
+    if (a && a <= n && t && t <= DB_NUM_TYPES && factor >= 0 &&
+        factor <= UINT8_MAX) {
+      d->type_efficacy[a][t] = factor;
+    }
+  }
+}
+
+static void parse_pokemon_evolution(db_set *d, const csv_file *f)
+{
+  csv_cursor c;
+  unsigned i;
+
+  csv_begin(&c, f);
+  for (i = 1; i <= d->rows[tbl_pokemon_evolutions] && c.p != c.end; i++) {
+    d->pokemon_evolutions[i].id = csv_int(&c, 0);
+    d->pokemon_evolutions[i].evolved_species_id = csv_int(&c, 0);
+    d->pokemon_evolutions[i].evolution_trigger_id = csv_int(&c, -1);
+    csv_skip(&c); // trigger_item_id
+    d->pokemon_evolutions[i].minimum_level = csv_int(&c, -1);
+    csv_next_line(&c);
+  }
+}
+
+/* Cold columns stay unparsed until the first time anything asks for *
+ * them, which the game itself never does.  The CSV is parsed again   *
+ * for just those columns, so this works after a snapshot load too.   */
+static void parse_cold(db_set *d, const char *name,
+                       void (*parse)(db_set *d, const csv_file *f))
+{
+  csv_file f;
+
+  // The game is running by now, and the CSVs may be mid-edit
+  if (!csv_map(&f, d->prefix, name, true)) {
+    exit(1);
+  }
+  parse(d, &f);
+  csv_unmap(&f);
+}
+
+const move_cold_db &move_cold(int i)
+{
+  db_set *d = db_cur;
+
+  if (db_builtin) {
+    return builtin_moves_cold[i];
+  }
+
+  std::call_once(d->moves_cold_once, [d]() {
+    d->moves_cold = (move_cold_db *) calloc(d->rows[tbl_moves] + 1,
+                                            sizeof (*d->moves_cold));
+    parse_cold(d, "moves.csv", parse_moves_cold);
+  });
+
+  return d->moves_cold[i];
+}
+
+const pokemon_species_cold_db &species_cold(int i)
+{
+  db_set *d = db_cur;
+
+  if (db_builtin) {
+    return builtin_species_cold[i];
+  }
+
+  std::call_once(d->species_cold_once, [d]() {
+    d->species_cold = ((pokemon_species_cold_db *)
+                       calloc(d->rows[tbl_species] + 1,
+                              sizeof (*d->species_cold)));
+    parse_cold(d, "pokemon_species.csv", parse_species_cold);
+  });
+
+  return d->species_cold[i];
+}
+
+// Indexes rows 1 through n by name(row), keeping the first of duplicates
+template <class F>
+static void build_name_index(name_index *x, unsigned n, F name)
+{
+  unsigned i, *slot;
+
+  name_index_init(x, n);
+  for (i = 1; i <= n; i++) {
+    if (*name(i) && !*(slot = name_slot(x, name(i), name))) {
+      *slot = i;
+    }
+  }
+}
+
+/* The name indexes belong to the current set, which the globals point *
+ * into, so they can be built from the globals.                        */
+unsigned db_find_species(const char *identifier)
+{
+  auto name = [](unsigned i) { return species[i].identifier(); };
+  db_set *d = db_cur;
+
+  std::call_once(d->species_names_once, [&]() {
+    build_name_index(&d->species_names, num_species, name);
+  });
+
+  return *name_slot(&d->species_names, identifier, name);
+}
+
+unsigned db_find_move(const char *identifier)
+{
+  auto name = [](unsigned i) { return moves[i].identifier(); };
+  db_set *d = db_cur;
+
+  std::call_once(d->move_names_once, [&]() {
+    build_name_index(&d->move_names, num_moves, name);
+  });
+
+  return *name_slot(&d->move_names, identifier, name);
+}
+
+unsigned db_find_type(const char *identifier)
+{
+  auto name = [](unsigned i) { return (const char *) db_strings + types[i]; };
+  db_set *d = db_cur;
+
+  std::call_once(d->type_names_once, [&]() {
+    build_name_index(&d->type_names, num_types, name);
+  });
+
+  return *name_slot(&d->type_names, identifier, name);
+}
+
+static void print_tables()
+{
+  unsigned i, j;
+
+  for (i = 0; i < num_pokemon; i++) {
+    printf("%d %s %d %d %d %d %d %d\n", pokemon[i].id, pokemon[i].identifier(),
+           pokemon[i].species_id, pokemon[i].height, pokemon[i].weight,
+           pokemon[i].base_experience, pokemon[i].order, pokemon[i].is_default);
+  }
+
+  for (i = 0; i < num_moves; i++) {
+    printf("%d %s %d %d %d %d %d %d %d %d %d %d %d %d %d\n",
+           moves[i].id,
+           moves[i].identifier(),
+           move_cold(i).generation_id,
+           moves[i].type_id,
+           moves[i].power,
+           moves[i].pp,
+           moves[i].accuracy,
+           moves[i].priority,
+           move_cold(i).target_id,
+           moves[i].damage_class_id,
+           move_cold(i).effect_id,
+           move_cold(i).effect_chance,
+           move_cold(i).contest_type_id,
+           move_cold(i).contest_effect_id,
+           move_cold(i).super_contest_effect_id);
+  }
+
+  for (i = 0; i < num_pokemon_moves; i++) {
+    printf("%d %d %d %d %d %d\n",
+           pokemon_moves[i].pokemon_id,
+           pokemon_moves[i].version_group_id,
+           pokemon_moves[i].move_id,
+           pokemon_moves[i].pokemon_move_method_id,
+           pokemon_moves[i].level,
+           pokemon_moves[i].order);
+  }
+
+  for (i = 0; i <= num_species; i++) {
+    printf("%d %s %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d\n",
+           species[i].id,
+           species[i].identifier(),
+           species_cold(i).generation_id,
+           species[i].evolves_from_species_id,
+           species[i].evolution_chain_id,
+           species_cold(i).color_id,
+           species_cold(i).shape_id,
+           species[i].habitat_id,
+           species[i].gender_rate,
+           species[i].capture_rate,
+           species_cold(i).base_happiness,
+           species_cold(i).is_baby,
+           species_cold(i).hatch_counter,
+           species_cold(i).has_gender_differences,
+           species[i].growth_rate_id,
+           species_cold(i).forms_switchable,
+           species_cold(i).is_legendary,
+           species_cold(i).is_mythical,
+           species_cold(i).order,
+           species_cold(i).conquest_order);
+  }
+
+  for (i = 0; i <= num_experience; i++) {
+    printf("%d %d %d\n",
+           experience[i].growth_rate_id,
+           experience[i].level,
+           experience[i].experience);
+  }
+
+  for (i = 1; i <= num_types; i++) {
+    printf("%s\n", db_strings + types[i]);
+  }
+
+  for (i = 0; i <= num_pokemon_stats; i++) {
+    printf("%d %d %d %d\n",
+           pokemon_stats[i].pokemon_id,
+           pokemon_stats[i].stat_id,
+           pokemon_stats[i].base_stat,
+           pokemon_stats[i].effort);
+  }
+
+  for (i = 0; i <= num_pokemon_types; i++) {
+    printf("%d %d %d\n",
+           pokemon_types[i].pokemon_id,
+           pokemon_types[i].type_id,
+           pokemon_types[i].slot);
+  }
+
+  for (i = 1; i <= DB_NUM_TYPES; i++) {
+    for (j = 1; j <= DB_NUM_TYPES; j++) {
+      printf("%d%c", type_efficacy[i][j], j < DB_NUM_TYPES ? ' ' : '\n');
+    }
+  }
+
+  for (i = 0; i <= num_pokemon_evolutions; i++) {
+    printf("%d %d %d %d\n",
+           pokemon_evolutions[i].id,
+           pokemon_evolutions[i].evolved_species_id,
+           pokemon_evolutions[i].evolution_trigger_id,
+           pokemon_evolutions[i].minimum_level);
+  }
+}
+
+/* Files are parsed whole by parse, unless they are big enough to be *
+ * worth splitting.  Those are cut into chunks that parse_rows parses *
+ * starting at a given table row, returning the number of rows it     *
+ * kept.  Every file fills the arena table that its row count sizes. */
+static const struct {
+  const char *name;
+  db_table table;
+  void (*parse)(db_set *d, const csv_file *f);
+  unsigned (*parse_rows)(db_set *d, csv_cursor *c, unsigned row);
+} db_files[] = {
+  { "pokemon.csv",           tbl_pokemon,
+    parse_pokemon,           NULL                     },
+  { "moves.csv",             tbl_moves,
+    parse_moves,             NULL                     },
+  { "pokemon_moves.csv",     tbl_pokemon_moves,
+    NULL,                    parse_pokemon_moves_rows },
+  { "pokemon_species.csv",   tbl_species,
+    parse_species,           NULL                     },
+  { "experience.csv",        tbl_experience,
+    parse_experience,        NULL                     },
+  { "type_names.csv",        tbl_types,
+    parse_type_names,        NULL                     },
+  { "pokemon_stats.csv",     tbl_pokemon_stats,
+    parse_pokemon_stats,     NULL                     },
+  { "pokemon_types.csv",     tbl_pokemon_types,
+    parse_pokemon_types,     NULL                     },
+  { "type_efficacy.csv",     tbl_type_efficacy,
+    parse_type_efficacy,     NULL                     },
+  { "pokemon_evolution.csv", tbl_pokemon_evolutions,
+    parse_pokemon_evolution, NULL                     },
+};
+
+#define NUM_DB_FILES (sizeof (db_files) / sizeof (db_files[0]))
+
+db_config db_conf = {
+  true, // parallel
+  0,    // threads
+  true, // precompute
+  { 1 }, // move_methods: level-up only
+  { },   // version_groups: all
+  "",    // csv_dir: search the usual places
+  false, // watch
+  "",    // shm_name: no shared segment
+  true   // snapshot
+};
+
+static unsigned db_threads()
+{
+  if (!db_conf.parallel) {
+    return 1;
+  }
+
+  return db_conf.threads ? db_conf.threads : parallel_threads();
+}
+
+// Bytes of a splittable file handed to each worker
+#define DB_CHUNK_SIZE (256 * 1024)
+
+/* One unit of parse work: a whole file, or a run of complete rows of *
+ * a splittable file that parses into the table from row `row` on.    */
+struct db_chunk {
+  unsigned file;
+  csv_cursor c;
+  unsigned row;
+  unsigned kept;
+  double seconds;
+};
+
+db_load_stats db_stats;
+
+static double db_clock()
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* Parses every CSV, in parallel if configured.  Files are independent *
+ * and each gets its own task; splittable files are cut into chunks at *
+ * newline boundaries, counted to find each chunk's first row, and     *
+ * then parsed chunk-wise alongside the other files.  Chunks that drop *
+ * rows leave gaps, which are packed out afterwards.  Files are copied *
+ * rather than mapped if copy.  Returns false, with nothing parsed, if *
+ * any of them can't be read.                                          */
+static bool parse_files(db_set *d, bool copy)
+{
+  csv_file f[NUM_DB_FILES];
+  std::vector<db_chunk> chunks;
+  std::vector<char> strings;
+  unsigned threads, i, j, n, rows;
+  const char *p, *nl, *end;
+  double t;
+  db_chunk k;
+
+  t = db_clock();
+  threads = db_threads();
+  build_ingest_filter(&keep_method, db_conf.move_methods);
+  build_ingest_filter(&keep_version_group, db_conf.version_groups);
+
+  for (i = 0; i < NUM_DB_FILES; i++) {
+    if (!csv_map(f + i, d->prefix, db_files[i].name, copy)) {
+      while (i--) {
+        csv_unmap(f + i);
+      }
+      return false;
+    }
+
+    k.file = i;
+    k.row = k.kept = 0;
+    k.seconds = 0;
+    csv_begin(&k.c, f + i);
+    if (!db_files[i].parse_rows) {
+      chunks.push_back(k);
+      continue;
+    }
+    for (end = k.c.end, p = k.c.p; p != end; p = nl) {
+      if ((size_t) (end - p) > DB_CHUNK_SIZE &&
+          (nl = (const char *) memchr(p + DB_CHUNK_SIZE, '\n',
+                                      end - p - DB_CHUNK_SIZE))) {
+        nl++;
+      } else {
+        nl = end;
+      }
+      csv_range(&k.c, p, nl);
+      chunks.push_back(k);
+    }
+  }
+  db_stats.map = db_clock() - t;
+
+  t = db_clock();
+  parallel_for(chunks.size(), threads, [&](unsigned n) {
+    chunks[n].row = count_rows(chunks[n].c);
+  });
+  // Chunk row counts become first rows and size the arena's tables
+  for (i = 0; i < NUM_DB_FILES; i++) {
+    for (rows = 0, j = 0; j < chunks.size(); j++) {
+      if (chunks[j].file == i) {
+        n = chunks[j].row;
+        chunks[j].row = rows + 1;
+        rows += n;
+      }
+    }
+    d->rows[db_files[i].table] = rows;
+  }
+  d->rows[tbl_strings] = 0;
+  alloc_arena(d);
+  for (i = 0; i < num_db_tables; i++) {
+    parse_strings[i].assign(1, '\0');
+  }
+  db_stats.count = db_clock() - t;
+
+  t = db_clock();
+  parallel_for(chunks.size(), threads, [&](unsigned n) {
+    double start = db_clock();
+
+    if (db_files[chunks[n].file].parse_rows) {
+      chunks[n].kept = db_files[chunks[n].file].parse_rows(d, &chunks[n].c,
+                                                           chunks[n].row);
+    } else {
+      db_files[chunks[n].file].parse(d, f + chunks[n].file);
+    }
+    chunks[n].seconds = db_clock() - start;
+  });
+  db_stats.parse = db_clock() - t;
+
+  t = db_clock();
+
+  // Close the gaps left by filtered rows
+  db_stats.files.resize(NUM_DB_FILES);
+  for (i = 0; i < NUM_DB_FILES; i++) {
+    db_stats.files[i].name = db_files[i].name;
+    db_stats.files[i].bytes = f[i].len;
+    db_stats.files[i].seconds = 0;
+    for (j = 0; j < chunks.size(); j++) {
+      if (chunks[j].file == i) {
+        db_stats.files[i].seconds += chunks[j].seconds;
+      }
+    }
+    if (db_files[i].parse_rows) {
+      for (rows = 0, j = 0; j < chunks.size(); j++) {
+        if (chunks[j].file == i) {
+          if (chunks[j].row != rows + 1) {
+            memmove(d->pokemon_moves + rows + 1,
+                    d->pokemon_moves + chunks[j].row,
+                    chunks[j].kept * sizeof (*d->pokemon_moves));
+          }
+          rows += chunks[j].kept;
+        }
+      }
+      d->rows[db_files[i].table] = rows;
+    }
+    csv_unmap(f + i);
+  }
+  d->rows[tbl_types] = d->num_types;
+  d->rows[tbl_type_efficacy] = std::min(d->rows[tbl_type_efficacy],
+                                        (unsigned) DB_NUM_TYPES);
+  for (i = 0; i < NUM_DB_FILES; i++) {
+    db_stats.files[i].rows = d->rows[db_files[i].table];
+  }
+
+  intern_strings(d, &strings);
+  for (i = 0; i < num_db_tables; i++) {
+    std::vector<char>().swap(parse_strings[i]);
+  }
+  d->rows[tbl_strings] = strings.size();
+  pack_arena(d);
+  memcpy(d->strings, strings.data(), strings.size());
+  db_stats.intern = db_clock() - t;
+
+  return true;
+}
+
+#define DB_SNAPSHOT_MAGIC "P327SNAP"
+#define DB_SNAPSHOT_VERSION 9
+#define DB_SNAPSHOT_NAME "/.poke327/pokedex.snapshot"
+
+struct db_file_stamp {
+  int64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+};
+
+// The snapshot is this header and the arena image at the next cache line
+struct db_snapshot_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_tables;
+  uint32_t row_size[num_db_tables];
+  uint32_t rows[num_db_tables];
+  uint64_t filter_hash;
+  // The CSV directory, so that copies of it elsewhere don't match
+  uint64_t dir_dev;
+  uint64_t dir_ino;
+  db_file_stamp stamp[NUM_DB_FILES];
+  // arena_hash() of the image, which is all that's known only once saved
+  uint64_t arena_hash;
+};
+
+/* Hashes the arena image in four lanes of 8-byte words, so that the  *
+ * multiplies overlap and checking a snapshot costs little more than   *
+ * reading it.  Every step is a bijection of its lane, so any one word *
+ * that differs always changes the result.                             */
+static uint64_t arena_hash(const char *p, size_t n)
+{
+  const uint64_t k = 0x9e3779b97f4a7c15ULL;
+  uint64_t lane[4] = { 1, 2, 3, 4 }, w, h;
+  size_t i;
+  unsigned j;
+
+  for (i = 0; i + sizeof (lane) <= n; i += sizeof (lane)) {
+    for (j = 0; j < 4; j++) {
+      memcpy(&w, p + i + j * sizeof (w), sizeof (w));
+      lane[j] = (lane[j] ^ w) * k;
+      lane[j] ^= lane[j] >> 29;
+    }
+  }
+  for (; i < n; i++) {
+    lane[0] = (lane[0] ^ (unsigned char) p[i]) * k;
+  }
+
+  for (h = n, j = 0; j < 4; j++) {
+    h = (h ^ lane[j]) * k;
+    h ^= h >> 32;
+  }
+
+  return h;
+}
+
+// FNV-1a over the ingest filter, which decides what pokemon_moves holds
+static uint64_t filter_hash()
 {
-  int i;
-  static char *s;
+  const std::vector<int> *lists[] = {
+    &db_conf.move_methods,
+    &db_conf.version_groups
+  };
+  uint64_t h = 14695981039346656037ULL;
+  unsigned i, j;
 
-  if (start) {
-    s = start;
+  for (i = 0; i < sizeof (lists) / sizeof (lists[0]); i++) {
+    for (j = 0; j <= lists[i]->size(); j++) {
+      h = (h ^ (j < lists[i]->size() ? (uint32_t) (*lists[i])[j] : ~0U)) *
+        1099511628211ULL;
+    }
   }
 
-  start = s;
+  return h;
+}
+
+/* Everything that decides whether a snapshot is still good; the row *
+ * counts come from the CSVs and are filled in once they are known.  */
+static void snapshot_header(db_snapshot_header *h, const char *prefix)
+{
+  char path[PATH_MAX];
+  struct stat buf;
+  unsigned i;
 
-  for (i = 0; s[i] && s[i] != delim; i++)
-    ;
-  s[i] = '\0';
-  s = s + i + 1;
+  memset(h, 0, sizeof (*h));
+  memcpy(h->magic, DB_SNAPSHOT_MAGIC, sizeof (h->magic));
+  h->version = DB_SNAPSHOT_VERSION;
+  h->num_tables = num_db_tables;
+  for (i = 0; i < num_db_tables; i++) {
+    h->row_size[i] = table_row_size[i];
+  }
+  h->filter_hash = filter_hash();
+  if (!stat(prefix, &buf)) {
+    h->dir_dev = buf.st_dev;
+    h->dir_ino = buf.st_ino;
+  }
+  for (i = 0; i < NUM_DB_FILES; i++) {
+    snprintf(path, sizeof (path), "%s%s", prefix, db_files[i].name);
+    if (!stat(path, &buf)) {
+      h->stamp[i].size = buf.st_size;
+      h->stamp[i].mtime_sec = buf.st_mtim.tv_sec;
+      h->stamp[i].mtime_nsec = buf.st_mtim.tv_nsec;
+    }
+  }
+}
+
+static char *snapshot_path()
+{
+  char *path;
+
+  path = (char *) malloc(strlen(getenv("HOME")) + strlen(DB_SNAPSHOT_NAME) + 1);
+  strcpy(path, getenv("HOME"));
+  strcat(path, DB_SNAPSHOT_NAME);
 
-  return start;
+  return path;
 }
 
-pokemon_move_db pokemon_moves[528239];
-pokemon_db pokemon[1093];
-char *types[19];
-move_db moves[845];
-pokemon_species_db species[899];
-experience_db experience[601];
-pokemon_stats_db pokemon_stats[6553];
+/* Returns true if the tables were loaded from a valid snapshot.  The *
+ * arena is used where it lies in a private mapping of the file, so    *
+ * only the pages something touches are ever read.                    */
+static bool snapshot_load(db_set *d, db_snapshot_header *expected)
+{
+  const db_snapshot_header *h;
+  struct stat buf;
+  size_t size;
+  char *path;
+  unsigned i;
+  void *m;
+  int fd;
 
-void db_parse(bool print)
+  if (!db_conf.snapshot) {
+    return false;
+  }
+
+  path = snapshot_path();
+  fd = open(path, O_RDONLY);
+  free(path);
+  if (fd < 0) {
+    return false;
+  }
+  if (fstat(fd, &buf) || (size_t) buf.st_size < sizeof (*expected) ||
+      (m = mmap(NULL, buf.st_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+    close(fd);
+    return false;
+  }
+  close(fd);
+
+  h = (const db_snapshot_header *) m;
+  memcpy(expected->rows, h->rows, sizeof (expected->rows));
+  memcpy(d->rows, h->rows, sizeof (d->rows));
+  expected->arena_hash = h->arena_hash;
+  size = DB_ALIGN(sizeof (*h)) + layout_tables(d);
+  // A damaged image would send string offsets and rows out of bounds
+  if (memcmp(h, expected, sizeof (*expected)) ||
+      size != (size_t) buf.st_size ||
+      arena_hash((const char *) m + DB_ALIGN(sizeof (*h)),
+                 size - DB_ALIGN(sizeof (*h))) != h->arena_hash) {
+    munmap(m, buf.st_size);
+    return false;
+  }
+
+  free_arena(d);
+  d->mapping = m;
+  d->mapping_size = buf.st_size;
+  d->arena = (char *) m + DB_ALIGN(sizeof (*h));
+  d->arena_size = layout_tables(d);
+  bind_tables(d);
+
+  // Movesets live outside the snapshot and are rebuilt after loading
+  for (i = 0; i <= d->rows[tbl_species]; i++) {
+    d->species[i].initialized = false;
+  }
+
+  return true;
+}
+
+/* Best effort; a snapshot that can't be written just means the next *
+ * start parses the CSVs again.  Written to a temporary file and     *
+ * renamed so that a concurrent start never sees a partial file.     */
+static void snapshot_save(db_set *d, db_snapshot_header *h)
 {
+  static const char pad[64] = { 0 };
+  size_t n = DB_ALIGN(sizeof (*h)) - sizeof (*h);
+  char *path, *tmp;
+  bool ok;
   FILE *f;
-  char line[800];
-  int i;
-  char *tmp;
+
+  path = snapshot_path();
+  tmp = (char *) malloc(strlen(path) + 24);
+
+  // ~/.poke327 may not exist yet if the CSVs came from /share
+  strcpy(tmp, path);
+  *strrchr(tmp, '/') = '\0';
+  mkdir(tmp, 0755);
+
+  sprintf(tmp, "%s.%d", path, (int) getpid());
+
+  memcpy(h->rows, d->rows, sizeof (h->rows));
+  h->arena_hash = arena_hash(d->arena, d->arena_size);
+
+  if ((f = fopen(tmp, "w"))) {
+    ok = (fwrite(h, sizeof (*h), 1, f) == 1 &&
+          fwrite(pad, 1, n, f) == n &&
+          fwrite(d->arena, d->arena_size, 1, f) == 1);
+    ok = !fclose(f) && ok;
+    if (!ok || rename(tmp, path)) {
+      unlink(tmp);
+    }
+  }
+
+  free(tmp);
+  free(path);
+}
+
+/* Counting sort of pokemon_moves by (pokemon_id, method): one pass to *
+ * size every bucket, a prefix sum for the offsets, and a second pass  *
+ * to fill the buckets, which keeps rows within a bucket in file order. */
+static void build_pokemon_move_index(db_set *d)
+{
+  const pokemon_move_db *m = d->pokemon_moves;
+  pokemon_move_index *x = &d->move_idx;
+  unsigned i, k, n;
+  unsigned *fill;
+
+  n = d->rows[tbl_pokemon_moves] + 1;
+
+  for (x->num_pokemon = x->num_methods = 0, i = 1; i < n; i++) {
+    if (m[i].pokemon_id >= x->num_pokemon) {
+      x->num_pokemon = m[i].pokemon_id + 1;
+    }
+    if (m[i].pokemon_move_method_id >= x->num_methods) {
+      x->num_methods = m[i].pokemon_move_method_id + 1;
+    }
+  }
+
+  k = x->num_pokemon * x->num_methods;
+  x->offsets = (unsigned *) calloc(k + 1, sizeof (*x->offsets));
+  fill = (unsigned *) malloc((k + 1) * sizeof (*fill));
+
+  for (i = 1; i < n; i++) {
+    if (m[i].pokemon_id >= 0 && m[i].pokemon_move_method_id >= 0) {
+      x->offsets[m[i].pokemon_id * x->num_methods +
+                 m[i].pokemon_move_method_id + 1]++;
+    }
+  }
+  for (i = 0; i < k; i++) {
+    x->offsets[i + 1] += x->offsets[i];
+  }
+
+  x->moves = (levelup_move *) malloc(x->offsets[k] * sizeof (*x->moves));
+  memcpy(fill, x->offsets, (k + 1) * sizeof (*fill));
+  for (i = 1; i < n; i++) {
+    if (m[i].pokemon_id >= 0 && m[i].pokemon_move_method_id >= 0) {
+      k = fill[m[i].pokemon_id * x->num_methods +
+               m[i].pokemon_move_method_id]++;
+      x->moves[k].level = m[i].level;
+      x->moves[k].move = m[i].move_id;
+    }
+  }
+
+  free(fill);
+}
+
+static const levelup_move *move_slice(const pokemon_move_index *x,
+                                      int pokemon_id, int method,
+                                      unsigned *num)
+{
+  unsigned k;
+
+  if (pokemon_id < 0 || pokemon_id >= x->num_pokemon ||
+      method < 0 || method >= x->num_methods) {
+    *num = 0;
+    return NULL;
+  }
+
+  k = pokemon_id * x->num_methods + method;
+  *num = x->offsets[k + 1] - x->offsets[k];
+
+  return x->moves + x->offsets[k];
+}
+
+const levelup_move *pokemon_move_slice(int pokemon_id, int method,
+                                       unsigned *num)
+{
+  return move_slice(&pokemon_move_idx, pokemon_id, method, num);
+}
+
+static int compare_move(const void *v1, const void *v2)
+{
+  return ((levelup_move *) v1)->level - ((levelup_move *) v2)->level;
+}
+
+/* Gives every species a slot in the levelup_moves arena big enough for *
+ * all of its level-up rows, so that species can be initialized in any *
+ * order, or concurrently, without allocating.                          */
+static void layout_species(db_set *d)
+{
+  unsigned i, n, total;
+
+  for (total = 0, i = 1; i <= d->rows[tbl_species]; i++) {
+    move_slice(&d->move_idx, d->species[i].id, 1, &n);
+    d->species[i].levelup_offset = total;
+    total += n;
+  }
+
+  d->levelup_size = total;
+  d->levelup_moves = (levelup_move *) malloc((total ? total : 1) *
+                                             sizeof (*d->levelup_moves));
+}
+
+/* Builds the sorted level-up moveset, base stats and types of       *
+ * species[i] in its arena slot.  Only species[i] and its slot are    *
+ * written, so any number of species may be initialized at once.      */
+static void init_species(db_set *d, int i)
+{
+  pokemon_species_db *s = d->species + i;
+  const pokemon_type_db *t;
+  const levelup_move *learnset;
+  std::vector<bool> seen;
+  levelup_move *l;
+  unsigned j, n;
+
+  // The index hands us every level-up row for this pokemon; we only
+  // need to drop the moves repeated across version groups.
+  learnset = move_slice(&d->move_idx, s->id, 1, &n);
+  l = d->levelup_moves + s->levelup_offset;
+  seen.resize(d->rows[tbl_moves] + 1);
+  for (s->num_levelup_moves = 0, j = 0; j < n; j++) {
+    if ((unsigned) learnset[j].move < seen.size() && !seen[learnset[j].move]) {
+      seen[learnset[j].move] = true;
+      l[s->num_levelup_moves++] = learnset[j];
+    }
+  }
+  qsort(l, s->num_levelup_moves, sizeof (*l), compare_move);
+
+  for (j = 0; j < 6; j++) {
+    if ((unsigned) i * 6 - 5 + j <= d->rows[tbl_pokemon_stats]) {
+      s->base_stat[j] = d->pokemon_stats[i * 6 - 5 + j].base_stat;
+    }
+  }
+
+  // pokemon_types is sorted by pokemon, and a species is its own default
+  t = std::lower_bound(d->pokemon_types + 1,
+                       d->pokemon_types + d->rows[tbl_pokemon_types] + 1, i,
+                       [](const pokemon_type_db &p, int id) {
+                         return p.pokemon_id < id;
+                       });
+  s->type[0] = s->type[1] = 0;
+  for (; t <= d->pokemon_types + d->rows[tbl_pokemon_types] &&
+         t->pokemon_id == i; t++) {
+    if ((t->slot == 1 || t->slot == 2) && t->type_id > 0 &&
+        t->type_id <= DB_NUM_TYPES) {
+      s->type[t->slot - 1] = t->type_id;
+    }
+  }
+
+  // Publishes the rest of the row to db_species_ready() on other threads
+  __atomic_store_n(&s->initialized, true, __ATOMIC_RELEASE);
+}
+
+void db_init_species(int i)
+{
+  db_set *d = db_cur;
+  std::lock_guard<std::mutex> lock(d->species_lock);
+
+  // Some other thread may have built it while this one waited
+  if (!__atomic_load_n(&d->species[i].initialized, __ATOMIC_RELAXED)) {
+    init_species(d, i);
+  }
+}
+
+/* Scatters experience[] into the dense curves.  A level missing from *
+ * the CSV needs as much experience as the next one that isn't, which *
+ * keeps every row sorted for level_for_experience().                 */
+static void build_experience_curves(db_set *d)
+{
+  const experience_db *e;
+  unsigned i, n;
+  int l;
+
+  for (n = 0, i = 1; i <= d->rows[tbl_experience]; i++) {
+    if (d->experience[i].growth_rate_id > (int) n) {
+      n = d->experience[i].growth_rate_id;
+    }
+  }
+
+  d->num_growth_rates = n;
+  d->experience_curve = (int (*)[DB_CURVE_LEVELS])
+    malloc((n + 1) * sizeof (*d->experience_curve));
+  for (i = 0; i <= n; i++) {
+    d->experience_curve[i][0] = 0;
+    for (l = 1; l < DB_CURVE_LEVELS; l++) {
+      d->experience_curve[i][l] = INT_MAX;
+    }
+  }
+
+  for (i = 1; i <= d->rows[tbl_experience]; i++) {
+    e = d->experience + i;
+    if (e->growth_rate_id > 0 && e->level > 0 && e->level < DB_CURVE_LEVELS) {
+      d->experience_curve[e->growth_rate_id][e->level] = e->experience;
+    }
+  }
+
+  for (i = 0; i <= n; i++) {
+    for (l = DB_CURVE_LEVELS - 2; l > 0; l--) {
+      if (d->experience_curve[i][l] > d->experience_curve[i][l + 1]) {
+        d->experience_curve[i][l] = d->experience_curve[i][l + 1];
+      }
+    }
+  }
+}
+
+/* Orders the species chain by chain, breadth first from each chain's *
+ * first stages, so that every species' children end up side by side. *
+ * A species whose parent is missing or in another chain starts a     *
+ * chain of its own stages; one caught in a cycle, which no real data  *
+ * has, is made a first stage to break it.                             */
+static void build_evolution_index(db_set *d)
+{
+  evolution_index *x = &d->evolution_idx;
+  unsigned n = d->rows[tbl_species], i, c, pos, end;
+  std::vector<unsigned> fill, child_offsets(n + 2, 0), children(n);
+  std::vector<bool> placed(n + 1, false);
+  const pokemon_evolution_db *e;
+  species_evolution *s;
+  int level;
+
+  auto chain = [d](unsigned i) {
+    return (unsigned) std::max(d->species[i].evolution_chain_id, 0);
+  };
+  // Species i's parent within its chain, or 0
+  auto parent = [d, n, &chain](unsigned i) -> unsigned {
+    int p = d->species[i].evolves_from_species_id;
+
+    return (p > 0 && (unsigned) p <= n && p != (int) i &&
+            chain(p) == chain(i)) ? (unsigned) p : 0;
+  };
+  auto place = [&](unsigned i) {
+    x->order[fill[chain(i)]++] = i;
+    placed[i] = true;
+  };
+
+  for (x->num_chains = 0, i = 1; i <= n; i++) {
+    x->num_chains = std::max(x->num_chains, chain(i));
+  }
+  x->chain_offsets = (unsigned *) calloc(x->num_chains + 2,
+                                         sizeof (*x->chain_offsets));
+  x->species = (species_evolution *) calloc(n + 1, sizeof (*x->species));
+  for (i = 1; i <= n; i++) {
+    if (chain(i)) {
+      x->chain_offsets[chain(i) + 1]++;
+    }
+  }
+  for (c = 1; c <= x->num_chains; c++) {
+    x->chain_offsets[c + 1] += x->chain_offsets[c];
+  }
+  x->order = (int *) malloc((x->chain_offsets[x->num_chains + 1] + 1) *
+                            sizeof (*x->order));
+
+  // Children by parent, in id order
+  for (i = 1; i <= n; i++) {
+    child_offsets[parent(i) + 1]++;
+  }
+  for (i = 1; i <= n; i++) {
+    child_offsets[i + 1] += child_offsets[i];
+  }
+  for (fill.assign(child_offsets.begin(), child_offsets.end()), i = 1;
+       i <= n; i++) {
+    children[fill[parent(i)]++] = i;
+  }
+
+  fill.assign(x->chain_offsets, x->chain_offsets + x->num_chains + 1);
+  for (i = 1; i <= n; i++) {
+    if (chain(i) && !parent(i)) {
+      place(i);
+    }
+  }
+  for (c = 1; c <= x->num_chains; c++) {
+    for (pos = x->chain_offsets[c]; pos < x->chain_offsets[c + 1]; pos++) {
+      if (pos == fill[c]) {
+        for (i = 1; placed[i] || chain(i) != c; i++)
+          ;
+        place(i);
+      }
+      s = x->species + x->order[pos];
+      s->first_child = fill[c];
+      end = child_offsets[x->order[pos] + 1];
+      for (i = child_offsets[x->order[pos]]; i < end; i++) {
+        if (!placed[children[i]]) {
+          place(children[i]);
+          s->num_children++;
+        }
+      }
+    }
+  }
+
+  // The lowest level at which each species evolves by leveling up
+  for (i = 1; i <= d->rows[tbl_pokemon_evolutions]; i++) {
+    e = d->pokemon_evolutions + i;
+    level = e->minimum_level;
+    if (e->evolution_trigger_id == DB_EVOLVE_LEVEL_UP && level > 0 &&
+        e->evolved_species_id > 0 && (unsigned) e->evolved_species_id <= n) {
+      s = x->species + e->evolved_species_id;
+      if (!s->evolution_level || level < s->evolution_level) {
+        s->evolution_level = level;
+      }
+    }
+  }
+}
+
+/* A shared segment is a snapshot that is fully loaded: the arena with *
+ * every species initialized, followed by the move index and levelup    *
+ * arena, which are ordinary allocations in a private set.  The name    *
+ * carries the filter hash, so that processes with different filters   *
+ * never fight over one segment.                                        */
+struct db_shm_header {
+  db_snapshot_header snapshot;
+  // Set last, once the rest of the segment is written
+  uint32_t ready;
+  int32_t num_pokemon;
+  int32_t num_methods;
+  uint32_t levelup_size;
+  uint64_t offsets_at;
+  uint64_t moves_at;
+  uint64_t levelup_at;
+  uint64_t size;
+};
+
+// How long to wait on another process that is still writing a segment
+#define DB_SHM_WAIT_MS 1000
+
+static std::string shm_name(const db_snapshot_header *h)
+{
+  char hash[24];
+
+  snprintf(hash, sizeof (hash), "-%016llx",
+           (unsigned long long) h->filter_hash);
+
+  return db_conf.shm_name + hash;
+}
+
+// Lays out the segment for d, filling in everything but the snapshot
+static void shm_layout(const db_set *d, db_shm_header *h)
+{
+  const pokemon_move_index *x = &d->move_idx;
+  unsigned k = x->num_pokemon * x->num_methods;
+
+  h->ready = 0;
+  h->num_pokemon = x->num_pokemon;
+  h->num_methods = x->num_methods;
+  h->levelup_size = d->levelup_size;
+  h->offsets_at = DB_ALIGN(sizeof (*h)) + d->arena_size;
+  h->moves_at = DB_ALIGN(h->offsets_at + (k + 1) * sizeof (*x->offsets));
+  h->levelup_at = DB_ALIGN(h->moves_at + x->offsets[k] * sizeof (*x->moves));
+  h->size = DB_ALIGN(h->levelup_at + d->levelup_size *
+                     sizeof (*d->levelup_moves));
+}
+
+/* Maps the segment read-only and makes a set of it, if it's there and *
+ * matches the CSVs.  A segment that doesn't match is unlinked, so that *
+ * the caller can publish a fresh one; anyone still attached keeps it.  */
+static db_set *shm_attach(db_snapshot_header *expected)
+{
+  const db_shm_header *h;
+  std::string name;
+  struct stat buf;
+  unsigned i;
+  db_set *d;
+  void *m;
+  int fd;
+
+  name = shm_name(expected);
+  if ((fd = shm_open(name.c_str(), O_RDONLY, 0)) < 0) {
+    return NULL;
+  }
+  if (fstat(fd, &buf) || (size_t) buf.st_size < sizeof (*h) ||
+      (m = mmap(NULL, buf.st_size, PROT_READ, MAP_SHARED, fd, 0)) ==
+      MAP_FAILED) {
+    close(fd);
+    return NULL;
+  }
+  close(fd);
+
+  h = (const db_shm_header *) m;
+  for (i = 0; !__atomic_load_n(&h->ready, __ATOMIC_ACQUIRE); i++) {
+    if (i == DB_SHM_WAIT_MS) {
+      // Whoever was writing it is gone
+      munmap(m, buf.st_size);
+      shm_unlink(name.c_str());
+      return NULL;
+    }
+    usleep(1000);
+  }
+
+  memcpy(expected->rows, h->snapshot.rows, sizeof (expected->rows));
+  expected->arena_hash = h->snapshot.arena_hash;
+  if (memcmp(&h->snapshot, expected, sizeof (*expected)) ||
+      h->size != (uint64_t) buf.st_size) {
+    munmap(m, buf.st_size);
+    shm_unlink(name.c_str());
+    return NULL;
+  }
+
+  d = new db_set();
+  d->shared = true;
+  d->mapping = m;
+  d->mapping_size = buf.st_size;
+  d->arena = (char *) m + DB_ALIGN(sizeof (*h));
+  memcpy(d->rows, h->snapshot.rows, sizeof (d->rows));
+  d->arena_size = layout_tables(d);
+  bind_tables(d);
+  d->move_idx.num_pokemon = h->num_pokemon;
+  d->move_idx.num_methods = h->num_methods;
+  d->move_idx.offsets = (unsigned *) ((char *) m + h->offsets_at);
+  d->move_idx.moves = (levelup_move *) ((char *) m + h->moves_at);
+  d->levelup_moves = (levelup_move *) ((char *) m + h->levelup_at);
+  d->levelup_size = h->levelup_size;
+
+  return d;
+}
+
+/* Writes d, which must have every species initialized, to a new       *
+ * segment.  Fails if some other process got there first.              */
+static bool shm_publish(const db_set *d, const db_snapshot_header *snapshot)
+{
+  const pokemon_move_index *x = &d->move_idx;
+  std::string name;
+  db_shm_header *h;
+  char *m;
+  int fd;
+
+  name = shm_name(snapshot);
+  if ((fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644)) < 0) {
+    return false;
+  }
+
+  h = (db_shm_header *) calloc(1, sizeof (*h));
+  h->snapshot = *snapshot;
+  memcpy(h->snapshot.rows, d->rows, sizeof (h->snapshot.rows));
+  shm_layout(d, h);
+  if (ftruncate(fd, h->size) ||
+      (m = (char *) mmap(NULL, h->size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED, fd, 0)) == MAP_FAILED) {
+    close(fd);
+    shm_unlink(name.c_str());
+    free(h);
+    return false;
+  }
+  close(fd);
+
+  memcpy(m, h, sizeof (*h));
+  memcpy(m + DB_ALIGN(sizeof (*h)), d->arena, d->arena_size);
+  memcpy(m + h->offsets_at, x->offsets,
+         (x->num_pokemon * x->num_methods + 1) * sizeof (*x->offsets));
+  memcpy(m + h->moves_at, x->moves,
+         x->offsets[x->num_pokemon * x->num_methods] * sizeof (*x->moves));
+  memcpy(m + h->levelup_at, d->levelup_moves,
+         d->levelup_size * sizeof (*d->levelup_moves));
+  __atomic_store_n(&((db_shm_header *) m)->ready, 1, __ATOMIC_RELEASE);
+
+  munmap(m, h->size);
+  free(h);
+
+  return true;
+}
+
+// Where the CSVs are; exits if they are nowhere to be found
+static char *find_prefix()
+{
   struct stat buf;
   char *prefix;
-  int prefix_len;
-  int j;
-  int count;
-  
-  i = (strlen(getenv("HOME")) +
-       strlen("/.poke327/pokedex/pokedex/data/csv/") + 1);
-  prefix = (char *) malloc(i);
-  strcpy(prefix, getenv("HOME"));
-  strcat(prefix, "/.poke327/pokedex/pokedex/data/csv/");
-
-  if (stat(prefix, &buf)) {
-    free(prefix);
-    prefix = NULL;
-  }
-
-  if (!prefix && !stat("/share/cs327", &buf)) {
-    prefix = strdup("/share/cs327/pokedex/pokedex/data/csv/");
-  } else if (!prefix) {
-    // Your third location goes here, if needed.
-    // prefix is freed later, so be sure you malloc it
-  }
-
-  //No error checking on file load from here on out.  Missing
-  //files are "user error".
-  prefix_len = strlen(prefix);
-
-  prefix = (char *) realloc(prefix, prefix_len + strlen("pokemon.csv") + 1);
-  strcpy(prefix + prefix_len, "pokemon.csv");
-  
-  f = fopen(prefix, "r");
-
-  //No null byte copied here, so prefix is not technically a string anymore.
-  prefix = (char *) realloc(prefix, prefix_len + 1);
-
-  fgets(line, 80, f);
-  
-  for (i = 1; i <= 1092; i++) {
-    fgets(line, 80, f);
-    pokemon[i].id = atoi(next_token(line, ','));
-    strncpy(pokemon[i].identifier, next_token(NULL, ','), 30);
-    pokemon[i].species_id = atoi(next_token(NULL, ','));
-    pokemon[i].height = atoi(next_token(NULL, ','));
-    pokemon[i].weight = atoi(next_token(NULL, ','));
-    pokemon[i].base_experience = atoi(next_token(NULL, ','));
-    pokemon[i].order = atoi(next_token(NULL, ','));
-    pokemon[i].is_default = atoi(next_token(NULL, ','));
-  }  
-
-  fclose(f);
-  
-  if (print) {
-    for (i = 0; i < 1092; i++) {
-      printf("%d %s %d %d %d %d %d %d\n", pokemon[i].id, pokemon[i].identifier,
-             pokemon[i].species_id, pokemon[i].height, pokemon[i].weight,
-             pokemon[i].base_experience, pokemon[i].order, pokemon[i].is_default);
-    }
-  }
-
-
-  prefix = (char *) realloc(prefix, prefix_len + strlen("moves.csv") + 1);
-  strcpy(prefix + prefix_len, "moves.csv");
-  
-  f = fopen(prefix, "r");
-
-  //No null byte copied here, so prefix is not technically a string anymore.
-  prefix = (char *) realloc(prefix, prefix_len + 1);
-
-  fgets(line, 800, f);
-  
-  for (i = 1; i <= 844; i++) {
-    fgets(line, 800, f);
-    moves[i].id = atoi((tmp = next_token(line, ',')));
-    strcpy(moves[i].identifier, (tmp = next_token(NULL, ',')));
-    tmp = next_token(NULL, ',');
-    moves[i].generation_id = *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    moves[i].type_id =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    moves[i].power =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    moves[i].pp =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    moves[i].accuracy =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    moves[i].priority =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    moves[i].target_id =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    moves[i].damage_class_id =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    moves[i].effect_id =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    moves[i].effect_chance =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    moves[i].contest_type_id =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    moves[i].contest_effect_id =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    moves[i].super_contest_effect_id =  *tmp ? atoi(tmp) : -1;
-  }
-
-  fclose(f);
-  
-  if (print) {
-    for (i = 0; i < 844; i++) {
-      printf("%d %s %d %d %d %d %d %d %d %d %d %d %d %d %d\n",
-             moves[i].id,
-             moves[i].identifier,
-             moves[i].generation_id,
-             moves[i].type_id,
-             moves[i].power,
-             moves[i].pp,
-             moves[i].accuracy,
-             moves[i].priority,
-             moves[i].target_id,
-             moves[i].damage_class_id,
-             moves[i].effect_id,
-             moves[i].effect_chance,
-             moves[i].contest_type_id,
-             moves[i].contest_effect_id,
-             moves[i].super_contest_effect_id);
-    }
-  }
-
-  prefix = (char *) realloc(prefix, prefix_len + strlen("pokemon_moves.csv") + 1);
-  strcpy(prefix + prefix_len, "pokemon_moves.csv");
-  
-  f = fopen(prefix, "r");
-
-  //No null byte copied here, so prefix is not technically a string anymore.
-  prefix = (char *) realloc(prefix, prefix_len + 1);
-
-  fgets(line, 800, f);
-  
-  for (i = 1; i <= 528238; i++) {
-    fgets(line, 800, f);
-    tmp = next_token(line, ',');
-    pokemon_moves[i].pokemon_id = *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    pokemon_moves[i].version_group_id = *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    pokemon_moves[i].move_id = *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    pokemon_moves[i].pokemon_move_method_id = *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    pokemon_moves[i].level = *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    pokemon_moves[i].order = (*tmp != '\n') ? atoi(tmp) : -1;
-  }
-
-  fclose(f);
+  unsigned i;
 
-  if (print) {
-    for (i = 0; i < 528238; i++) {
-      printf("%d %d %d %d %d %d\n",
-             pokemon_moves[i].pokemon_id,
-             pokemon_moves[i].version_group_id,
-             pokemon_moves[i].move_id,
-             pokemon_moves[i].pokemon_move_method_id,
-             pokemon_moves[i].level,
-             pokemon_moves[i].order);
-    }
-  }
-
-  prefix = (char *) realloc(prefix, prefix_len + strlen("pokemon_species.csv") + 1);
-  strcpy(prefix + prefix_len, "pokemon_species.csv");
-  
-  f = fopen(prefix, "r");
-
-  //No null byte copied here, so prefix is not technically a string anymore.
-  prefix = (char *) realloc(prefix, prefix_len + 1);
-
-  fgets(line, 800, f);
-  
-  for (i = 1; i <= 898; i++) {
-    fgets(line, 800, f);
-    species[i].id = atoi((tmp = next_token(line, ',')));
-    strcpy(species[i].identifier, (tmp = next_token(NULL, ',')));
-    tmp = next_token(NULL, ',');
-    species[i].generation_id = *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].evolves_from_species_id =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].evolution_chain_id =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].color_id =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].shape_id =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].habitat_id =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].gender_rate =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].capture_rate =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].base_happiness =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].is_baby =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].hatch_counter =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].has_gender_differences =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].growth_rate_id =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].forms_switchable =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].is_legendary =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].is_mythical =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].order =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].conquest_order =  *tmp ? atoi(tmp) : -1;
-    species[i].levelup_moves = 0;
-    species[i].num_levelup_moves = 0;
-    species[i].base_stat[0] = species[i].base_stat[1] =
-      species[i].base_stat[2] = species[i].base_stat[3] =
-      species[i].base_stat[4] = species[i].base_stat[5] = 0;
-    
-  }
-
-  fclose(f);
+  if (!db_conf.csv_dir.empty()) {
+    prefix = (char *) malloc(db_conf.csv_dir.size() + 2);
+    strcpy(prefix, db_conf.csv_dir.c_str());
+    if (prefix[strlen(prefix) - 1] != '/') {
+      strcat(prefix, "/");
+    }
+  } else {
+    i = (strlen(getenv("HOME")) +
+         strlen("/.poke327/pokedex/pokedex/data/csv/") + 1);
+    prefix = (char *) malloc(i);
+    strcpy(prefix, getenv("HOME"));
+    strcat(prefix, "/.poke327/pokedex/pokedex/data/csv/");
 
-  if (print) {
-    for (i = 0; i <= 898; i++) {
-      printf("%d %s %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d\n",
-             species[i].id,
-             species[i].identifier,
-             species[i].generation_id,
-             species[i].evolves_from_species_id,
-             species[i].evolution_chain_id,
-             species[i].color_id,
-             species[i].shape_id,
-             species[i].habitat_id,
-             species[i].gender_rate,
-             species[i].capture_rate,
-             species[i].base_happiness,
-             species[i].is_baby,
-             species[i].hatch_counter,
-             species[i].has_gender_differences,
-             species[i].growth_rate_id,
-             species[i].forms_switchable,
-             species[i].is_legendary,
-             species[i].is_mythical,
-             species[i].order,
-             species[i].conquest_order);
-    }
-  }
-
-
-  prefix = (char *) realloc(prefix, prefix_len + strlen("experience.csv") + 1);
-  strcpy(prefix + prefix_len, "experience.csv");
-  
-  f = fopen(prefix, "r");
-
-  //No null byte copied here, so prefix is not technically a string anymore.
-  prefix = (char *) realloc(prefix, prefix_len + 1);
-
-  fgets(line, 800, f);
-  
-  for (i = 1; i <= 600; i++) {
-    fgets(line, 800, f);
-    experience[i].growth_rate_id = atoi((tmp = next_token(line, ',')));
-    tmp = next_token(NULL, ',');
-    experience[i].level = *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    experience[i].experience =  *tmp ? atoi(tmp) : -1;
-  }
-
-  fclose(f);
+    if (stat(prefix, &buf)) {
+      free(prefix);
+      prefix = NULL;
+    }
 
-  if (print) {
-    for (i = 0; i <= 600; i++) {
-      printf("%d %d %d\n",
-             experience[i].growth_rate_id,
-             experience[i].level,
-             experience[i].experience);
-    }
-  }
-
-  prefix = (char *) realloc(prefix, prefix_len + strlen("type_names.csv") + 1);
-  strcpy(prefix + prefix_len, "type_names.csv");
-  
-  f = fopen(prefix, "r");
-
-  //No null byte copied here, so prefix is not technically a string anymore.
-  prefix = (char *) realloc(prefix, prefix_len + 1);
-
-  fgets(line, 800, f);
-  
-  for (i = 1; i <= 18; i++) {
-    fgets(line, 800, f); //  1
-    fgets(line, 800, f); //  3
-    fgets(line, 800, f); //  4
-    fgets(line, 800, f); //  5
-    fgets(line, 800, f); //  6
-    fgets(line, 800, f); //  7
-    fgets(line, 800, f); //  8
-    fgets(line, 800, f); //  9 - English
-    for (j = count = 0; count < 2; j++) {
-      if (line[j] == ',') {
-        count++;
+    if (!prefix && !stat("/share/cs327", &buf)) {
+      prefix = strdup("/share/cs327/pokedex/pokedex/data/csv/");
+    } else if (!prefix) {
+      // Your third location goes here, if needed.
+      // prefix is freed later, so be sure you malloc it
+    }
+  }
+
+  if (!prefix) {
+    fprintf(stderr, "Could not find the pokedex database.\n");
+    exit(1);
+  }
+
+  return prefix;
+}
+
+/* Loads a complete set from the CSVs under prefix, which the set takes *
+ * over, or from the snapshot of them, or attaches to the shared        *
+ * segment.  Touches nothing that the current set uses, but only one    *
+ * set may be loading at a time.  A reload copies the CSVs, which might *
+ * be edited as they are read, and returns NULL rather than exiting if  *
+ * they can't be.                                                       */
+static db_set *load_set(char *prefix, bool reload)
+{
+  db_snapshot_header header;
+  double start, t;
+  db_set *d, *s;
+
+  start = db_clock();
+  db_stats = db_load_stats();
+  snapshot_header(&header, prefix);
+
+  if (!db_conf.shm_name.empty() && (d = shm_attach(&header))) {
+    d->prefix = prefix;
+    build_experience_curves(d);
+    build_evolution_index(d);
+    db_stats.source = "shm";
+    db_stats.total = db_clock() - start;
+    return d;
+  }
+
+  d = new db_set();
+  d->prefix = prefix;
+
+  if (snapshot_load(d, &header)) {
+    db_stats.source = "snapshot";
+  } else {
+    db_stats.source = "csv";
+    if (!parse_files(d, reload)) {
+      free_set(d);
+      return NULL;
+    }
+    if (db_conf.snapshot) {
+      snapshot_save(d, &header);
+    }
+  }
+
+  t = db_clock();
+  build_pokemon_move_index(d);
+  layout_species(d);
+  build_experience_curves(d);
+  build_evolution_index(d);
+  db_stats.index = db_clock() - t;
+
+  // Nobody can initialize species in a read-only segment later on
+  t = db_clock();
+  if (db_conf.precompute || !db_conf.shm_name.empty()) {
+    parallel_for(d->rows[tbl_species], db_threads(),
+                 [d](unsigned n) { init_species(d, n + 1); });
+  }
+  db_stats.species = db_clock() - t;
+
+  // Trade the private copy for the segment, to share it with the rest
+  if (!db_conf.shm_name.empty() && shm_publish(d, &header) &&
+      (s = shm_attach(&header))) {
+    s->prefix = d->prefix;
+    s->experience_curve = d->experience_curve;
+    s->num_growth_rates = d->num_growth_rates;
+    s->evolution_idx = d->evolution_idx;
+    d->prefix = NULL;
+    d->experience_curve = NULL;
+    d->evolution_idx = evolution_index();
+    free_set(d);
+    d = s;
+  }
+  db_stats.total = db_clock() - start;
+
+  return d;
+}
+
+unsigned db_generation;
+
+/* Points the globals at d, which becomes the current set, and frees *
+ * the set they pointed at before.  Nothing may be using the old one. */
+static void publish(db_set *d)
+{
+  db_set *old = db_cur;
+
+#define PUBLISH(table, id)                      \
+  table = d->table;                             \
+  num_##table = d->rows[id]
+
+  PUBLISH(pokemon, tbl_pokemon);
+  PUBLISH(moves, tbl_moves);
+  PUBLISH(species, tbl_species);
+  PUBLISH(experience, tbl_experience);
+  PUBLISH(pokemon_stats, tbl_pokemon_stats);
+  PUBLISH(types, tbl_types);
+  PUBLISH(pokemon_types, tbl_pokemon_types);
+  PUBLISH(pokemon_evolutions, tbl_pokemon_evolutions);
+  PUBLISH(pokemon_moves, tbl_pokemon_moves);
+
+#undef PUBLISH
+
+  db_strings = d->strings;
+  pokemon_move_idx = d->move_idx;
+  levelup_moves = d->levelup_moves;
+  type_efficacy = d->type_efficacy;
+  experience_curve = d->experience_curve;
+  num_growth_rates = d->num_growth_rates;
+  evolution_idx = d->evolution_idx;
+  db_cur = d;
+  db_generation++;
+
+  if (old) {
+    free_set(old);
+  }
+}
+
+/* A reloaded set waiting for db_sync().  The watcher only ever swaps a *
+ * new set in here, and db_sync() only ever swaps one out, so a set is  *
+ * never freed while the game can still see it.                        */
+static std::atomic<db_set *> db_next;
+
+// Editors tend to write a file in several steps; wait for them to finish
+#define DB_WATCH_SETTLE_MS 200
+
+static void watch_csvs(char *prefix)
+{
+  alignas (inotify_event) char buf[4096];
+  const inotify_event *e;
+  struct pollfd pfd;
+  bool changed;
+  unsigned i;
+  ssize_t n;
+  db_set *d;
+  char *p;
+
+  pfd.events = POLLIN;
+  if ((pfd.fd = inotify_init1(IN_CLOEXEC)) < 0 ||
+      inotify_add_watch(pfd.fd, prefix, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    perror(prefix);
+    free(prefix);
+    return;
+  }
+
+  for (;;) {
+    for (changed = false; !changed; ) {
+      if ((n = read(pfd.fd, buf, sizeof (buf))) <= 0) {
+        continue;
       }
+      for (p = buf; p < buf + n; p += sizeof (*e) + e->len) {
+        e = (const inotify_event *) p;
+        for (i = 0; e->len && i < NUM_DB_FILES; i++) {
+          changed = changed || !strcmp(e->name, db_files[i].name);
+        }
+      }
+    }
+    while (poll(&pfd, 1, DB_WATCH_SETTLE_MS) > 0 &&
+           read(pfd.fd, buf, sizeof (buf)) > 0)
+      ;
+
+    // Until the CSVs can all be read again, the game keeps what it has
+    if (!(d = load_set(strdup(prefix), true))) {
+      continue;
+    }
+    // A set that the game never picked up can simply be dropped
+    if ((d = db_next.exchange(d, std::memory_order_acq_rel))) {
+      free_set(d);
     }
-    line[strlen(line) - 1] = '\0';
-    types[i] = strdup(line + j);
-    fgets(line, 800, f); // 11
-    fgets(line, 800, f); // 12
   }
+}
+
+static void db_load()
+{
+  static std::once_flag watch_once;
+  db_set *d;
+
+  if (!(d = load_set(find_prefix(), false))) {
+    exit(1);
+  }
+  publish(d);
+
+  if (db_conf.watch) {
+    std::call_once(watch_once, []() {
+      std::thread(watch_csvs, strdup(db_cur->prefix)).detach();
+    });
+  }
+}
 
-  fclose(f);
+/* Live Pokemon hold species, move and pokemon rows, which have to stay *
+ * in range of whatever set they are read from next.                   */
+static bool db_shrinks(const db_set *d)
+{
+  const db_table kept[] = { tbl_species, tbl_moves, tbl_pokemon };
+  unsigned i;
 
-  if (print) {
-    for (i = 1; i <= 18; i++) {
-      printf("%s\n", types[i]);
+  for (i = 0; i < sizeof (kept) / sizeof (kept[0]); i++) {
+    if (d->rows[kept[i]] < db_cur->rows[kept[i]]) {
+      return true;
     }
   }
 
-  prefix = (char *) realloc(prefix, prefix_len + strlen("pokemon_stats.csv") + 1);
-  strcpy(prefix + prefix_len, "pokemon_stats.csv");
-  
-  f = fopen(prefix, "r");
+  return false;
+}
+
+void db_sync()
+{
+  db_set *d;
+
+  if (db_next.load(std::memory_order_relaxed) &&
+      (d = db_next.exchange(NULL, std::memory_order_acq_rel))) {
+    if (db_shrinks(d)) {
+      free_set(d);
+    } else {
+      publish(d);
+    }
+  }
+}
 
-  //No null byte copied here, so prefix is not technically a string anymore.
-  prefix = (char *) realloc(prefix, prefix_len + 1);
+/* db_ready is set once any load has finished, and is what the game  *
+ * checks on every Pokemon; the lock is only for sleeping.  Neither   *
+ * the lock nor the condition is ever destroyed, since the loader     *
+ * thread may still be signalling while the process exits.            */
+static std::atomic<bool> db_ready;
+static std::mutex &db_ready_mutex = *new std::mutex;
+static std::condition_variable &db_ready_cond = *new std::condition_variable;
 
-  fgets(line, 800, f);
-  
-  for (i = 1; i <= 6552; i++) {
-    fgets(line, 800, f);
-    pokemon_stats[i].pokemon_id = atoi((tmp = next_token(line, ',')));
-    tmp = next_token(NULL, ',');
-    pokemon_stats[i].stat_id = *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    pokemon_stats[i].base_stat =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    pokemon_stats[i].effort =  *tmp ? atoi(tmp) : -1;
+void db_parse(bool print)
+{
+  if (!db_builtin) {
+    db_load();
   }
 
-  fclose(f);
+  {
+    std::lock_guard<std::mutex> lock(db_ready_mutex);
+    db_ready.store(true, std::memory_order_release);
+  }
+  db_ready_cond.notify_all();
 
   if (print) {
-    for (i = 0; i <= 6552; i++) {
-      printf("%d %d %d %d\n",
-             pokemon_stats[i].pokemon_id,
-             pokemon_stats[i].stat_id,
-             pokemon_stats[i].base_stat,
-             pokemon_stats[i].effort);
-    }
+    print_tables();
   }
 
   /*
@@ -398,13 +2320,25 @@ void db_parse(bool print)
   }
   printf("\n");
   */
-  
-  free(prefix);
 }
 
-pokemon_species_db::~pokemon_species_db()
+/* The loader thread is detached rather than joined, so that quitting *
+ * before it finishes doesn't have to wait for it.                    */
+void db_parse_async()
+{
+  std::thread([]() { db_parse(false); }).detach();
+}
+
+void db_wait()
 {
-  if (levelup_moves) {
-    free(levelup_moves);
+  std::unique_lock<std::mutex> lock(db_ready_mutex, std::defer_lock);
+
+  if (db_ready.load(std::memory_order_acquire)) {
+    return;
   }
+
+  lock.lock();
+  db_ready_cond.wait(lock, []() {
+    return db_ready.load(std::memory_order_acquire);
+  });
 }
@@ -1,30 +1,49 @@
 #ifndef DB_PARSE_H
 # define DB_PARSE_H
 
+#include <climits>
+#include <cstdint>
 #include <vector>
+#include <string>
+
+/* Identifiers are interned: each distinct one is stored once, NUL- *
+ * terminated, in db_strings, and rows keep its offset.  Offset 0 is *
+ * the empty string.                                                 */
+extern char *db_strings;
 
 struct pokemon_db {
   int id;
-  char identifier[30];
+  unsigned name;
   int species_id;
   int height;
   int weight;
   int base_experience;
   int order;
   int is_default;
+
+  const char *identifier() const { return db_strings + name; }
 };
 
+/* Moves and species are split into hot columns, read by the game and *
+ * kept densely packed in moves[] and species[], and cold columns that *
+ * nothing in the game reads.  Cold columns aren't parsed until the    *
+ * first call to move_cold() or species_cold().                        */
 struct move_db {
   int id;
-  char identifier[30];
-  int generation_id;
+  unsigned name;
   int type_id;
   int power;
   int pp;
   int accuracy;
   int priority;
-  int target_id;
   int damage_class_id;
+
+  const char *identifier() const { return db_strings + name; }
+};
+
+struct move_cold_db {
+  int generation_id;
+  int target_id;
   int effect_id;
   int effect_chance;
   int contest_type_id;
@@ -46,32 +65,45 @@ struct levelup_move {
   int move;
 };
 
+extern levelup_move *levelup_moves;
+
 struct pokemon_species_db {
   int id;
-  char identifier[30];
-  int generation_id;
+  unsigned name;
   int evolves_from_species_id;
   int evolution_chain_id;
-  int color_id;
-  int shape_id;
   int habitat_id;
   int gender_rate;
   int capture_rate;
+  int growth_rate_id;
+
+  // Filled in by db_init_species(); nothing below is valid until then
+  bool initialized;
+  unsigned levelup_offset;
+  unsigned num_levelup_moves;
+  int base_stat[6];
+  // From pokemon_types; the second is 0 for a species with only one
+  uint8_t type[2];
+
+  // Level-up moves sorted by level, stored in the levelup_moves arena
+  const levelup_move *levelup() const { return levelup_moves + levelup_offset; }
+
+  const char *identifier() const { return db_strings + name; }
+};
+
+struct pokemon_species_cold_db {
+  int generation_id;
+  int color_id;
+  int shape_id;
   int base_happiness;
   int is_baby;
   int hatch_counter;
   int has_gender_differences;
-  int growth_rate_id;
   int forms_switchable;
   int is_legendary;
   int is_mythical;
   int order;
   int conquest_order;
-
-  levelup_move *levelup_moves;
-  unsigned num_levelup_moves;
-  int base_stat[6];
-  ~pokemon_species_db();
 };
 
 struct experience_db {
@@ -80,6 +112,35 @@ struct experience_db {
   int experience;
 };
 
+/* experience[] rearranged at load time into one dense row per growth *
+ * rate: experience_curve[g][l] is the experience a pokemon of growth  *
+ * rate g needs to be level l.  Column 0 is 0, and levels past the     *
+ * last one in the CSV are INT_MAX, so every row is sorted and a power *
+ * of two long.  Row 0 is all INT_MAX past column 0.                   */
+#define DB_CURVE_LEVELS 128
+
+extern int (*experience_curve)[DB_CURVE_LEVELS];
+extern unsigned num_growth_rates;
+
+static inline int experience_for_level(int growth_rate, int level)
+{
+  return experience_curve[growth_rate][level];
+}
+
+/* The highest level whose experience is at most xp: a binary search *
+ * over the row with a fixed number of steps and no branches.         */
+static inline int level_for_experience(int growth_rate, int xp)
+{
+  const int *c = experience_curve[growth_rate];
+  unsigned i = 0, step;
+
+  for (step = DB_CURVE_LEVELS / 2; step; step >>= 1) {
+    i += (c[i + step] <= xp) ? step : 0;
+  }
+
+  return i;
+}
+
 struct pokemon_stats_db {
   int pokemon_id;
   int stat_id;
@@ -87,14 +148,178 @@ struct pokemon_stats_db {
   int effort;
 };
 
-extern pokemon_move_db pokemon_moves[528239];
-extern pokemon_db pokemon[1093];
-extern char *types[19];
-extern move_db moves[845];
-extern pokemon_species_db species[899];
-extern experience_db experience[601];
-extern pokemon_stats_db pokemon_stats[6553];
+struct pokemon_type_db {
+  int pokemon_id;
+  int type_id;
+  int slot;
+};
+
+/* type_efficacy as a matrix: type_efficacy[a][d] is the damage, in    *
+ * percent, that a move of type a does to a pokemon of type d.  Type 0 *
+ * is no type at all and 100 throughout; it stands in for the missing  *
+ * second type of a species and for any type past DB_NUM_TYPES.        */
+#define DB_NUM_TYPES 18
+
+extern uint8_t (*type_efficacy)[DB_NUM_TYPES + 1];
+
+// Damage against types t[0] and t[1] of a move of type a, in 1/10000ths
+static inline unsigned type_multiplier(int a, const uint8_t t[2])
+{
+  return type_efficacy[a][t[0]] * type_efficacy[a][t[1]];
+}
+
+struct pokemon_evolution_db {
+  int id;
+  int evolved_species_id;
+  int evolution_trigger_id;
+  int minimum_level;
+};
+
+// evolution_trigger_id of evolving by leveling up
+#define DB_EVOLVE_LEVEL_UP 1
+
+/* The evolution chains, built at load time.  order lists every species *
+ * in a chain, chain by chain, each breadth first from its first stage, *
+ * so that chain k is order[chain_offsets[k]] up to (not including)      *
+ * order[chain_offsets[k + 1]], and the species that evolve from s are   *
+ * the num_children entries from order[species[s].first_child] on.       */
+struct species_evolution {
+  unsigned first_child;
+  unsigned num_children;
+  // Level at which it evolves from its parent by leveling up, or 0
+  int evolution_level;
+};
+
+struct evolution_index {
+  unsigned num_chains;
+  unsigned *chain_offsets;
+  int *order;
+  species_evolution *species;
+};
+
+/* pokemon_moves in compressed sparse row form, keyed by pokemon and  *
+ * learn method.  The moves pokemon p learns by method m are           *
+ * moves[offsets[k]] up to (not including) moves[offsets[k + 1]],      *
+ * where k = p * num_methods + m, in the order they appear in the CSV. */
+struct pokemon_move_index {
+  int num_pokemon;
+  int num_methods;
+  unsigned *offsets;
+  levelup_move *moves;
+};
+
+/* Every table is sized to the CSV it came from.  Row 0 is unused, *
+ * so table[1] through table[num_table] are valid; types[1] through *
+ * types[num_types] are, where a type has an English name.  Only    *
+ * rows that pass the ingest filter in db_conf are in pokemon_moves. */
+extern pokemon_db *pokemon;
+extern move_db *moves;
+extern pokemon_move_db *pokemon_moves;
+extern pokemon_species_db *species;
+extern experience_db *experience;
+extern pokemon_stats_db *pokemon_stats;
+extern pokemon_type_db *pokemon_types;
+extern pokemon_evolution_db *pokemon_evolutions;
+// Offsets in db_strings of the type names, by type id
+extern unsigned *types;
+extern unsigned num_pokemon;
+extern unsigned num_moves;
+extern unsigned num_pokemon_moves;
+extern unsigned num_species;
+extern unsigned num_experience;
+extern unsigned num_pokemon_stats;
+extern unsigned num_pokemon_types;
+extern unsigned num_pokemon_evolutions;
+extern unsigned num_types;
+extern pokemon_move_index pokemon_move_idx;
+extern evolution_index evolution_idx;
+
+struct db_config {
+  // Parse the CSVs on worker threads instead of one after another
+  bool parallel;
+  // Worker threads for a parallel parse; 0 means one per core
+  unsigned threads;
+  // Build every species' moveset and base stats at load time
+  bool precompute;
+  // pokemon_moves rows to keep, by learn method and version group; an
+  // empty list keeps everything.  The game only uses level-up moves.
+  std::vector<int> move_methods;
+  std::vector<int> version_groups;
+  // Directory holding the CSVs; empty looks in ~/.poke327, then /share
+  std::string csv_dir;
+  // Reload the tables in the background whenever a CSV changes
+  bool watch;
+  // Share the loaded tables with other processes through a POSIX shared
+  // memory segment named after this; empty keeps them private.  The
+  // first process to load publishes them and the rest attach read-only.
+  std::string shm_name;
+  // Save the parsed tables to ~/.poke327 and load them from there for
+  // as long as the CSVs stay the same
+  bool snapshot;
+};
+
+extern db_config db_conf;
+
+/* Where the last load spent its time, for db_bench.  A file's seconds *
+ * are the time spent parsing its chunks, summed over all the threads  *
+ * that parsed them; rows are the rows it kept.  The phase times are   *
+ * wall clock.  Only a load from "csv" fills in files and the phases   *
+ * up to intern.                                                       */
+struct db_file_stats {
+  const char *name;
+  size_t bytes;
+  unsigned rows;
+  double seconds;
+};
+
+struct db_load_stats {
+  const char *source;  // "csv", "snapshot" or "shm"
+  std::vector<db_file_stats> files;
+  double map;          // Mapping the CSVs and cutting them into chunks
+  double count;        // Counting rows and sizing the arena
+  double parse;
+  double intern;       // Packing filtered rows and interning identifiers
+  double index;        // Move index, species layout, curves, evolutions
+  double species;      // Precomputed movesets and base stats
+  double total;
+};
+
+extern db_load_stats db_stats;
 
+/* Loads the tables, from the CSVs or a snapshot of them.  Does nothing *
+ * but print when built with POKEDEX_BUILTIN, since the tables are then *
+ * compiled in.                                                         */
 void db_parse(bool print);
+/* Runs db_parse(false) on a thread of its own.  Nothing may touch the *
+ * tables until db_wait() has returned; after that they're all there.  */
+void db_parse_async();
+// Returns once any db_parse(), on whatever thread, has finished
+void db_wait();
+/* Counts the sets of tables published so far, so that anything built *
+ * from them can tell when db_sync() has swapped in new ones.          */
+extern unsigned db_generation;
+/* Swaps in tables reloaded since the last call, if db_conf.watch is *
+ * set.  Call only where nothing holds pointers into the tables, and  *
+ * only from the one thread that reads them: the swap is atomic with  *
+ * respect to the watcher, not to other readers.  Reloads with fewer  *
+ * species, moves or pokemon than now are dropped, since Pokemon that *
+ * are alive already hold rows from the current tables.               */
+void db_sync();
+const levelup_move *pokemon_move_slice(int pokemon_id, int method,
+                                       unsigned *num);
+/* Whether species i has been built, and building it if not.  Both are *
+ * safe to call from any number of threads at once.                    */
+static inline bool db_species_ready(int i)
+{
+  return __atomic_load_n(&species[i].initialized, __ATOMIC_ACQUIRE);
+}
+void db_init_species(int i);
+const move_cold_db &move_cold(int i);
+const pokemon_species_cold_db &species_cold(int i);
+/* Row of the species, move or type with the given identifier, or 0 if *
+ * there is none.  The first call for each builds a hash index.         */
+unsigned db_find_species(const char *identifier);
+unsigned db_find_move(const char *identifier);
+unsigned db_find_type(const char *identifier);
 
 #endif
@@ -0,0 +1,110 @@
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+
+#include "encounter.h"
+#include "db_parse.h"
+
+/* Levels only change every other step of distance, so the bands are  *
+ * two steps wide.  Band b has levels 1 to b up to band 100, and b -   *
+ * 100 to 100 past it.                                                 */
+#define ENCOUNTER_BANDS (ENCOUNTER_MAX_DISTANCE / 2 + 1)
+#define ENCOUNTER_MAX_LEVEL 100
+
+// Alias probabilities are out of 2^31, the range of rng_int()
+#define ENCOUNTER_ONE (1u << 31)
+
+/* Walker's alias table over the species: slot i is species i + 1 with *
+ * probability threshold[i] / ENCOUNTER_ONE, and alias[i] + 1 with the *
+ * rest.                                                               */
+struct encounter_band
+{
+  int min_level, max_level;
+  std::vector<uint32_t> threshold;
+  std::vector<uint32_t> alias;
+};
+
+static encounter_band bands[ENCOUNTER_BANDS];
+// The db_generation the tables were built for; a reload makes them stale
+static unsigned bands_generation;
+
+// Builds band b's alias table with Vose's method, in exact integers
+static void build_band(encounter_band *e, int b)
+{
+  std::vector<uint64_t> p(num_species);
+  std::vector<uint32_t> small, large;
+  uint64_t total;
+  uint32_t s, l;
+  unsigned i;
+  int w;
+
+  e->min_level = std::max(b - ENCOUNTER_MAX_LEVEL, 1);
+  e->max_level = std::min(std::max(b, 1), ENCOUNTER_MAX_LEVEL);
+
+  // From capture rate at the center to all the same at the edge
+  for (total = 0, i = 0; i < num_species; i++)
+  {
+    w = std::min(std::max(species[i + 1].capture_rate, 1), 255);
+    p[i] = w + (uint64_t)(255 - w) * b / (ENCOUNTER_BANDS - 1);
+    total += p[i];
+  }
+
+  // Scaled by the number of slots, a slot's fair share is the total
+  for (i = 0; i < num_species; i++)
+  {
+    p[i] *= num_species;
+    (p[i] < total ? small : large).push_back(i);
+  }
+
+  e->threshold.assign(num_species, ENCOUNTER_ONE);
+  e->alias.resize(num_species);
+  for (i = 0; i < num_species; i++)
+  {
+    e->alias[i] = i;
+  }
+  while (!small.empty() && !large.empty())
+  {
+    s = small.back();
+    small.pop_back();
+    l = large.back();
+    e->threshold[s] = p[s] * ENCOUNTER_ONE / total;
+    e->alias[s] = l;
+    p[l] -= total - p[s];
+    if (p[l] < total)
+    {
+      large.pop_back();
+      small.push_back(l);
+    }
+  }
+}
+
+encounter_pick encounter_sample(int distance, rng *r)
+{
+  encounter_band *e;
+  encounter_pick pick;
+  unsigned i;
+
+  db_wait();
+
+  if (bands_generation != db_generation)
+  {
+    for (i = 0; i < ENCOUNTER_BANDS; i++)
+    {
+      bands[i].threshold.clear();
+    }
+    bands_generation = db_generation;
+  }
+
+  distance = std::min(std::max(distance, 0), ENCOUNTER_MAX_DISTANCE);
+  e = bands + distance / 2;
+  if (e->threshold.empty())
+  {
+    build_band(e, distance / 2);
+  }
+
+  i = rng_below(r, num_species);
+  pick.species = ((uint32_t)rng_int(r) < e->threshold[i] ? i : e->alias[i]) + 1;
+  pick.level = rng_below(r, e->max_level - e->min_level + 1) + e->min_level;
+
+  return pick;
+}
@@ -0,0 +1,24 @@
+#ifndef ENCOUNTER_H
+#define ENCOUNTER_H
+
+#include "rng.h"
+
+// Manhattan distances from the center of the world run 0 to this
+#define ENCOUNTER_MAX_DISTANCE 400
+
+struct encounter_pick
+{
+  int species;
+  int level;
+};
+
+/* Draws the species and level of a wild pokemon, or of one in a       *
+ * trainer's team, for a map at the given distance from the center.    *
+ * Levels are uniform over a range that climbs with the distance.      *
+ * Species are weighted by capture rate, so the ones that are hard to  *
+ * catch are rare near the center, evening out to uniform at the edge. *
+ * Each distance band's alias table is built the first time it's used  *
+ * and every draw after that is O(1).  Not thread safe.                */
+encounter_pick encounter_sample(int distance, rng *r);
+
+#endif
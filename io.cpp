@@ -10,6 +10,8 @@
 #include "character.h"
 #include "poke327.h"
 #include "pokemon.h"
+#include "db_parse.h"
+#include "encounter.h"
 
 typedef struct io_message
 {
@@ -397,6 +399,8 @@ void io_battle(Character *aggressor, Character *defender)
 {
   Npc *npc;
 
+  db_wait();
+
   io_display();
   mvprintw(0, 0, "Aww, how'd you get so strong?  You and your pokemon must share a special bond!");
   refresh();
@@ -546,42 +550,28 @@ void io_teleport_world(pair_t dest)
   io_teleport_pc(dest);
 }
 
-void io_encounter_pokemon()
+// Manhattan distance of the current map from the center of the world
+static int io_distance()
 {
-  Pokemon *p;
+  return (abs(world.cur_idx[dim_x] - (WORLD_SIZE / 2)) +
+          abs(world.cur_idx[dim_y] - (WORLD_SIZE / 2)));
+}
 
-  int md = (abs(world.cur_idx[dim_x] - (WORLD_SIZE / 2)) +
-            abs(world.cur_idx[dim_x] - (WORLD_SIZE / 2)));
-  int minl, maxl;
+// A pokemon drawn from the encounter table for the current map
+static Pokemon *io_make_encounter(Pokemon_arena *a)
+{
+  encounter_pick e = encounter_sample(io_distance(), &game_rng);
 
-  if (md <= 200)
-  {
-    minl = 1;
-    maxl = md / 2;
-  }
-  else
-  {
-    minl = (md - 200) / 2;
-    maxl = 100;
-  }
-  if (minl < 1)
-  {
-    minl = 1;
-  }
-  if (minl > 100)
-  {
-    minl = 100;
-  }
-  if (maxl < 1)
-  {
-    maxl = 1;
-  }
-  if (maxl > 100)
-  {
-    maxl = 100;
-  }
+  return a->make(e.species, e.level, &game_rng);
+}
 
-  p = new Pokemon(rand() % (maxl - minl + 1) + minl);
+void io_encounter_pokemon()
+{
+  // The wild pokemon only lives as long as the encounter
+  Pokemon_arena encounter;
+  Pokemon *p;
+
+  p = io_make_encounter(&encounter);
 
   //  std::cerr << *p << std::endl << std::endl;
 
@@ -636,9 +626,11 @@ void io_getItem(int inBattle, int itemIdx)
 
 void io_choose()
 {
-  Pokemon *p1 = new Pokemon(1);
-  Pokemon *p2 = new Pokemon(1);
-  Pokemon *p3 = new Pokemon(1);
+  // The choices are scratch; the PC keeps a copy of the chosen one
+  Pokemon_arena choices;
+  Pokemon *p1 = choices.make(1);
+  Pokemon *p2 = choices.make(1);
+  Pokemon *p3 = choices.make(1);
   mvprintw(0, 0, "Choose a pokemon: ");
   mvprintw(1, 5, "1. %s", p1->get_species());
   mvprintw(2, 5, "2. %s", p2->get_species());
@@ -663,21 +655,15 @@ void io_choose()
   switch (input)
   {
   case '1':
-    world.pc.pokemons[0] = p1;
-    delete p2;
-    delete p3;
+    world.pc.pokemons[0] = new Pokemon(*p1);
     break;
 
   case '2':
-    world.pc.pokemons[0] = p2;
-    delete p1;
-    delete p3;
+    world.pc.pokemons[0] = new Pokemon(*p2);
     break;
 
   case '3':
-    world.pc.pokemons[0] = p3;
-    delete p1;
-    delete p2;
+    world.pc.pokemons[0] = new Pokemon(*p3);
     break;
   }
 
@@ -688,52 +674,50 @@ void io_choose()
   getch();
 }
 
-void io_fightTrainer(Npc *npc)
+static void io_award_experience(Pokemon *winner, const Pokemon *loser)
 {
-  int i = 0;
-  for (i = 0; i < 6; i++)
-  {
-    npc->pokemons[i] = NULL;
-  }
-
-  i = 0;
+  int xp = loser->experience_yield();
+  std::vector<int> new_moves;
+  level_up_result r;
+  unsigned i;
 
-  int md = (abs(world.cur_idx[dim_x] - (WORLD_SIZE / 2)) +
-            abs(world.cur_idx[dim_x] - (WORLD_SIZE / 2)));
-  int minl, maxl;
-
-  if (md <= 200)
+  io_queue_message("%s gained %d experience.", winner->get_species(), xp);
+  level_up_batch(&winner, &xp, 1, &r, &new_moves);
+  if (r.evolved_from)
   {
-    minl = 1;
-    maxl = md / 2;
+    io_queue_message("%s evolved into %s!",
+                     species[r.evolved_from].identifier(),
+                     winner->get_species());
   }
-  else
+  if (r.levels)
   {
-    minl = (md - 200) / 2;
-    maxl = 100;
+    io_queue_message("%s grew to level %d!", winner->get_species(),
+                     winner->get_level());
   }
-  if (minl < 1)
+  for (i = 0; i < r.num_moves; i++)
   {
-    minl = 1;
+    io_queue_message("%s can now learn %s.", winner->get_species(),
+                     moves[new_moves[r.first_move + i]].identifier());
   }
-  if (minl > 100)
-  {
-    minl = 100;
-  }
-  if (maxl < 1)
-  {
-    maxl = 1;
-  }
-  if (maxl > 100)
+}
+
+void io_fightTrainer(Npc *npc)
+{
+  // The trainer's team is drawn up for this battle and gone after it
+  Pokemon_arena team;
+  int i = 0;
+  for (i = 0; i < 6; i++)
   {
-    maxl = 100;
+    npc->pokemons[i] = NULL;
   }
 
+  i = 0;
+
   int numOfPoke = 0;
 
-  for (i = 0; i < rand() % 6 + 1; i++)
+  for (i = 0; i < game_below(6) + 1; i++)
   {
-    npc->pokemons[i] = new Pokemon(rand() % (maxl - minl + 1) + minl);
+    npc->pokemons[i] = io_make_encounter(&team);
     numOfPoke++;
   }
 
@@ -748,6 +732,7 @@ void io_fightTrainer(Npc *npc)
     clear();
     if (npcPoke->get_hp() == 0)
     {
+      io_award_experience(cur, npcPoke);
       npcCurPIdx++;
       if (npcCurPIdx > numOfPoke)
         battle = 0;
@@ -778,8 +763,8 @@ void io_fightTrainer(Npc *npc)
       if (input == '2')
         move = 2;
 
-      dam = cur->get_dam(move, rand() % 16 + 85);
-      if (cur->get_acc(move) > rand() % 100)
+      dam = cur->get_dam(move, game_below(16) + 85, npcPoke);
+      if (cur->get_acc(move) > game_below(100))
         npcPoke->set_hp(-1 * dam);
       else
         dam = -1;
@@ -801,8 +786,8 @@ void io_fightTrainer(Npc *npc)
     }
     else if (input == 'b')
       io_backpack(1);
-    dam = npcPoke->get_dam(rand() % 1 + 1, rand() % 16 + 85);
-    if (npcPoke->get_acc(rand() % 1 + 1) > rand() % 100)
+    dam = npcPoke->get_dam(game_below(1) + 1, game_below(16) + 85, cur);
+    if (npcPoke->get_acc(game_below(1) + 1) > game_below(100))
       cur->set_hp(-1 * dam);
     else
       dam = -1;
@@ -817,6 +802,11 @@ void io_fightTrainer(Npc *npc)
 
     clear();
   } while (battle);
+
+  for (i = 0; i < 6; i++)
+  {
+    npc->pokemons[i] = NULL;
+  }
 }
 
 void io_fightPoke(Pokemon *p)
@@ -842,8 +832,8 @@ void io_fightPoke(Pokemon *p)
       int move = 0;
       if (input == '2')
         move = 2;
-      dam = cur->get_dam(move, rand() % 16 + 85);
-      if (cur->get_acc(move) > rand() % 100)
+      dam = cur->get_dam(move, game_below(16) + 85, p);
+      if (cur->get_acc(move) > game_below(100))
         p->set_hp(-1 * dam);
       else
         dam = -1;
@@ -869,14 +859,17 @@ void io_fightPoke(Pokemon *p)
     {
       int odds = ((cur->get_speed() * 32) / ((p->get_speed() / 4) % 256)) + 30 * runs;
       runs++;
-      if (odds > rand() % 256)
+      if (odds > game_below(256))
         battle = 0;
     }
     if (p->get_hp() == 0)
+    {
+      io_award_experience(cur, p);
       battle = 0;
+    }
 
-    dam = p->get_dam(rand() % 1 + 1, rand() % 16 + 85);
-    if (p->get_acc(rand() % 1 + 1) > rand() % 100)
+    dam = p->get_dam(game_below(1) + 1, game_below(16) + 85, cur);
+    if (p->get_acc(game_below(1) + 1) > game_below(100))
       cur->set_hp(-1 * dam);
     else
       dam = -1;
@@ -0,0 +1,46 @@
+#ifndef PARALLEL_H
+# define PARALLEL_H
+
+# include <atomic>
+# include <thread>
+# include <vector>
+
+/* Number of worker threads to use when the caller doesn't care. */
+static inline unsigned parallel_threads()
+{
+  unsigned n = std::thread::hardware_concurrency();
+
+  return n ? n : 1;
+}
+
+/* Calls fn(i) for every i in [0, n), handing indices out dynamically to *
+ * at most `threads` threads, the calling thread included.  Returns once *
+ * every call has finished.  fn must be safe to run concurrently.        */
+template <class F>
+void parallel_for(unsigned n, unsigned threads, F fn)
+{
+  std::atomic<unsigned> next(0);
+  std::vector<std::thread> workers;
+  unsigned i;
+
+  auto work = [&]() {
+    unsigned j;
+
+    while ((j = next++) < n) {
+      fn(j);
+    }
+  };
+
+  if (threads > n) {
+    threads = n;
+  }
+  for (i = 1; i < threads; i++) {
+    workers.emplace_back(work);
+  }
+  work();
+  for (i = 0; i < workers.size(); i++) {
+    workers[i].join();
+  }
+}
+
+#endif
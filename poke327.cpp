@@ -278,7 +278,7 @@ static int gaussian[5][5] = {
     {4, 16, 26, 16, 4},
     {1, 4, 7, 4, 1}};
 
-static int smooth_height(Map *m)
+static int smooth_height(Map *m, rng *r)
 {
   int32_t i, x, y;
   int32_t s, t, p, q;
@@ -293,8 +293,8 @@ static int smooth_height(Map *m)
   {
     do
     {
-      x = rand() % MAP_X;
-      y = rand() % MAP_Y;
+      x = rng_below(r, MAP_X);
+      y = rng_below(r, MAP_Y);
     } while (height[y][x]);
     height[y][x] = i;
     if (i == 1)
@@ -459,12 +459,12 @@ static int smooth_height(Map *m)
   return 0;
 }
 
-static void find_building_location(Map *m, pair_t p)
+static void find_building_location(Map *m, rng *r, pair_t p)
 {
   do
   {
-    p[dim_x] = rand() % (MAP_X - 5) + 3;
-    p[dim_y] = rand() % (MAP_Y - 10) + 5;
+    p[dim_x] = rng_below(r, MAP_X - 5) + 3;
+    p[dim_y] = rng_below(r, MAP_Y - 10) + 5;
 
     if ((((mapxy(p[dim_x] - 1, p[dim_y]) == ter_path) &&
           (mapxy(p[dim_x] - 1, p[dim_y] + 1) == ter_path)) ||
@@ -492,11 +492,11 @@ static void find_building_location(Map *m, pair_t p)
   } while (1);
 }
 
-static int place_pokemart(Map *m)
+static int place_pokemart(Map *m, rng *r)
 {
   pair_t p;
 
-  find_building_location(m, p);
+  find_building_location(m, r, p);
 
   mapxy(p[dim_x], p[dim_y]) = ter_mart;
   mapxy(p[dim_x] + 1, p[dim_y]) = ter_mart;
@@ -506,11 +506,11 @@ static int place_pokemart(Map *m)
   return 0;
 }
 
-static int place_center(Map *m)
+static int place_center(Map *m, rng *r)
 {
   pair_t p;
 
-  find_building_location(m, p);
+  find_building_location(m, r, p);
 
   mapxy(p[dim_x], p[dim_y]) = ter_center;
   mapxy(p[dim_x] + 1, p[dim_y]) = ter_center;
@@ -520,7 +520,7 @@ static int place_center(Map *m)
   return 0;
 }
 
-static int map_terrain(Map *m, int8_t n, int8_t s, int8_t e, int8_t w)
+static int map_terrain(Map *m, rng *r, int8_t n, int8_t s, int8_t e, int8_t w)
 {
   int32_t i, x, y;
   queue_node_t *head, *tail, *tmp;
@@ -529,10 +529,10 @@ static int map_terrain(Map *m, int8_t n, int8_t s, int8_t e, int8_t w)
   terrain_type_t type;
   int added_current = 0;
 
-  num_grass = rand() % 4 + 2;
-  num_clearing = rand() % 4 + 2;
-  num_mountain = rand() % 2 + 1;
-  num_forest = rand() % 2 + 1;
+  num_grass = rng_below(r, 4) + 2;
+  num_clearing = rng_below(r, 4) + 2;
+  num_mountain = rng_below(r, 2) + 1;
+  num_forest = rng_below(r, 2) + 1;
   num_total = num_grass + num_clearing + num_mountain + num_forest;
 
   memset(&m->map, 0, sizeof(m->map));
@@ -542,8 +542,8 @@ static int map_terrain(Map *m, int8_t n, int8_t s, int8_t e, int8_t w)
   {
     do
     {
-      x = rand() % MAP_X;
-      y = rand() % MAP_Y;
+      x = rng_below(r, MAP_X);
+      y = rng_below(r, MAP_Y);
     } while (m->map[y][x]);
     if (i == 0)
     {
@@ -592,7 +592,7 @@ static int map_terrain(Map *m, int8_t n, int8_t s, int8_t e, int8_t w)
 
     if (x - 1 >= 0 && !m->map[y][x - 1])
     {
-      if ((rand() % 100) < 80)
+      if (rng_below(r, 100) < 80)
       {
         m->map[y][x - 1] = (terrain_type_t)i;
         tail->next = (queue_node_t *)malloc(sizeof(*tail));
@@ -615,7 +615,7 @@ static int map_terrain(Map *m, int8_t n, int8_t s, int8_t e, int8_t w)
 
     if (y - 1 >= 0 && !m->map[y - 1][x])
     {
-      if ((rand() % 100) < 20)
+      if (rng_below(r, 100) < 20)
       {
         m->map[y - 1][x] = (terrain_type_t)i;
         tail->next = (queue_node_t *)malloc(sizeof(*tail));
@@ -638,7 +638,7 @@ static int map_terrain(Map *m, int8_t n, int8_t s, int8_t e, int8_t w)
 
     if (y + 1 < MAP_Y && !m->map[y + 1][x])
     {
-      if ((rand() % 100) < 20)
+      if (rng_below(r, 100) < 20)
       {
         m->map[y + 1][x] = (terrain_type_t)i;
         tail->next = (queue_node_t *)malloc(sizeof(*tail));
@@ -661,7 +661,7 @@ static int map_terrain(Map *m, int8_t n, int8_t s, int8_t e, int8_t w)
 
     if (x + 1 < MAP_X && !m->map[y][x + 1])
     {
-      if ((rand() % 100) < 80)
+      if (rng_below(r, 100) < 80)
       {
         m->map[y][x + 1] = (terrain_type_t)i;
         tail->next = (queue_node_t *)malloc(sizeof(*tail));
@@ -736,15 +736,15 @@ static int map_terrain(Map *m, int8_t n, int8_t s, int8_t e, int8_t w)
   return 0;
 }
 
-static int place_boulders(Map *m)
+static int place_boulders(Map *m, rng *r)
 {
   int i;
   int x, y;
 
-  for (i = 0; i < MIN_BOULDERS || rand() % 100 < BOULDER_PROB; i++)
+  for (i = 0; i < MIN_BOULDERS || rng_below(r, 100) < BOULDER_PROB; i++)
   {
-    y = rand() % (MAP_Y - 2) + 1;
-    x = rand() % (MAP_X - 2) + 1;
+    y = rng_below(r, MAP_Y - 2) + 1;
+    x = rng_below(r, MAP_X - 2) + 1;
     if (m->map[y][x] != ter_forest && m->map[y][x] != ter_path)
     {
       m->map[y][x] = ter_boulder;
@@ -754,15 +754,15 @@ static int place_boulders(Map *m)
   return 0;
 }
 
-static int place_trees(Map *m)
+static int place_trees(Map *m, rng *r)
 {
   int i;
   int x, y;
 
-  for (i = 0; i < MIN_TREES || rand() % 100 < TREE_PROB; i++)
+  for (i = 0; i < MIN_TREES || rng_below(r, 100) < TREE_PROB; i++)
   {
-    y = rand() % (MAP_Y - 2) + 1;
-    x = rand() % (MAP_X - 2) + 1;
+    y = rng_below(r, MAP_Y - 2) + 1;
+    x = rng_below(r, MAP_X - 2) + 1;
     if (m->map[y][x] != ter_mountain && m->map[y][x] != ter_path)
     {
       m->map[y][x] = ter_tree;
@@ -774,8 +774,8 @@ static int place_trees(Map *m)
 
 void rand_pos(pair_t pos)
 {
-  pos[dim_x] = (rand() % (MAP_X - 2)) + 1;
-  pos[dim_y] = (rand() % (MAP_Y - 2)) + 1;
+  pos[dim_x] = game_below(MAP_X - 2) + 1;
+  pos[dim_y] = game_below(MAP_Y - 2) + 1;
 }
 
 void new_hiker()
@@ -851,7 +851,7 @@ void new_char_other()
   c->pos[dim_y] = pos[dim_y];
   c->pos[dim_x] = pos[dim_x];
   c->ctype = char_other;
-  switch (rand() % 4)
+  switch (game_below(4))
   {
   case 0:
     c->mtype = move_pace;
@@ -886,7 +886,7 @@ void place_characters()
   do
   {
     // higher probability of non- hikers and rivals
-    switch (rand() % 10)
+    switch (game_below(10))
     {
     case 0:
       new_hiker();
@@ -899,7 +899,7 @@ void place_characters()
       break;
     }
   } while (++world.cur_map->num_trainers < MIN_TRAINERS ||
-           ((rand() % 100) < ADD_TRAINER_PROB));
+           (game_below(100) < ADD_TRAINER_PROB));
 }
 
 void init_pc()
@@ -908,8 +908,8 @@ void init_pc()
 
   do
   {
-    x = rand() % (MAP_X - 2) + 1;
-    y = rand() % (MAP_Y - 2) + 1;
+    x = game_below(MAP_X - 2) + 1;
+    y = game_below(MAP_Y - 2) + 1;
   } while (world.cur_map->map[y][x] != ter_path);
 
   world.pc.pos[dim_x] = x;
@@ -964,14 +964,30 @@ void place_pc()
   }
 }
 
+/* The exit in the edge that map (x, y) shares with the map to its north *
+ * (stream_exit_ns) or west (stream_exit_ew), span being the edge's       *
+ * length.  Both maps derive it alike, so they agree on it whichever is   *
+ * generated first.                                                       */
+static int map_exit(int x, int y, map_stream purpose, int span)
+{
+  rng r;
+
+  rng_derive(&r, world.seed, x, y, purpose);
+
+  return 3 + rng_below(&r, span - 6);
+}
+
 // New map expects cur_idx to refer to the index to be generated.  If that
 // map has already been generated then the only thing this does is set
-// cur_map.
+// cur_map.  Terrain, exits and buildings depend only on the seed and
+// cur_idx, never on which maps were generated before; the characters
+// placed on it come from the game's stream.
 int new_map(int teleport)
 {
   int d, p;
   int e, w, n, s;
   int x, y;
+  rng terrain, buildings;
 
   if (world.world[world.cur_idx[dim_y]][world.cur_idx[dim_x]])
   {
@@ -985,73 +1001,66 @@ int new_map(int teleport)
       world.world[world.cur_idx[dim_y]][world.cur_idx[dim_x]] =
           (Map *)malloc(sizeof(*world.cur_map));
 
-  smooth_height(world.cur_map);
+  rng_derive(&terrain, world.seed, world.cur_idx[dim_x],
+             world.cur_idx[dim_y], stream_terrain);
+  rng_derive(&buildings, world.seed, world.cur_idx[dim_x],
+             world.cur_idx[dim_y], stream_buildings);
+
+  smooth_height(world.cur_map, &terrain);
 
   if (!world.cur_idx[dim_y])
   {
     n = -1;
   }
-  else if (world.world[world.cur_idx[dim_y] - 1][world.cur_idx[dim_x]])
-  {
-    n = world.world[world.cur_idx[dim_y] - 1][world.cur_idx[dim_x]]->s;
-  }
   else
   {
-    n = 3 + rand() % (MAP_X - 6);
+    n = map_exit(world.cur_idx[dim_x], world.cur_idx[dim_y],
+                 stream_exit_ns, MAP_X);
   }
   if (world.cur_idx[dim_y] == WORLD_SIZE - 1)
   {
     s = -1;
   }
-  else if (world.world[world.cur_idx[dim_y] + 1][world.cur_idx[dim_x]])
-  {
-    s = world.world[world.cur_idx[dim_y] + 1][world.cur_idx[dim_x]]->n;
-  }
   else
   {
-    s = 3 + rand() % (MAP_X - 6);
+    s = map_exit(world.cur_idx[dim_x], world.cur_idx[dim_y] + 1,
+                 stream_exit_ns, MAP_X);
   }
   if (!world.cur_idx[dim_x])
   {
     w = -1;
   }
-  else if (world.world[world.cur_idx[dim_y]][world.cur_idx[dim_x] - 1])
-  {
-    w = world.world[world.cur_idx[dim_y]][world.cur_idx[dim_x] - 1]->e;
-  }
   else
   {
-    w = 3 + rand() % (MAP_Y - 6);
+    w = map_exit(world.cur_idx[dim_x], world.cur_idx[dim_y],
+                 stream_exit_ew, MAP_Y);
   }
   if (world.cur_idx[dim_x] == WORLD_SIZE - 1)
   {
     e = -1;
   }
-  else if (world.world[world.cur_idx[dim_y]][world.cur_idx[dim_x] + 1])
-  {
-    e = world.world[world.cur_idx[dim_y]][world.cur_idx[dim_x] + 1]->w;
-  }
   else
   {
-    e = 3 + rand() % (MAP_Y - 6);
+    e = map_exit(world.cur_idx[dim_x] + 1, world.cur_idx[dim_y],
+                 stream_exit_ew, MAP_Y);
   }
 
-  map_terrain(world.cur_map, n, s, e, w);
+  map_terrain(world.cur_map, &terrain, n, s, e, w);
 
-  place_boulders(world.cur_map);
-  place_trees(world.cur_map);
+  place_boulders(world.cur_map, &terrain);
+  place_trees(world.cur_map, &terrain);
   build_paths(world.cur_map);
   d = (abs(world.cur_idx[dim_x] - (WORLD_SIZE / 2)) +
        abs(world.cur_idx[dim_y] - (WORLD_SIZE / 2)));
   p = d > 200 ? 5 : (50 - ((45 * d) / 200));
   //  printf("d=%d, p=%d\n", d, p);
-  if ((rand() % 100) < p || !d)
+  if (rng_below(&buildings, 100) < p || !d)
   {
-    place_pokemart(world.cur_map);
+    place_pokemart(world.cur_map, &buildings);
   }
-  if ((rand() % 100) < p || !d)
+  if (rng_below(&buildings, 100) < p || !d)
   {
-    place_center(world.cur_map);
+    place_center(world.cur_map, &buildings);
   }
 
   for (y = 0; y < MAP_Y; y++)
@@ -1251,6 +1260,9 @@ void game_loop()
 
   while (!world.quit)
   {
+    // Between turns nobody is looking at the pokedex
+    db_sync();
+
     c = (Character *)heap_remove_min(&world.cur_map->turn);
     n = dynamic_cast<Npc *>(c);
     p = dynamic_cast<Pc *>(c);
@@ -1278,7 +1290,7 @@ void game_loop()
 
     if (p && (c->pos[dim_y] != d[dim_y] || c->pos[dim_x] != d[dim_x]) &&
         (world.cur_map->map[d[dim_y]][d[dim_x]] == ter_grass) &&
-        (rand() % 100 < ENCOUNTER_PROB))
+        (game_below(100) < ENCOUNTER_PROB))
     {
       io_encounter_pokemon();
     }
@@ -1290,6 +1302,46 @@ void game_loop()
   }
 }
 
+/* Times terrain generation alone: heights, terrain, boulders, trees   *
+ * and roads for n maps, with no characters.  Run with                  *
+ * POKE327_BENCH_TERRAIN=n, from builds with and without                *
+ * POKE327_LIBC_RAND, to compare random number generators.              */
+static void bench_terrain(int n)
+{
+  struct timeval start, end;
+  Map *m;
+  double secs;
+  rng r;
+  int i;
+
+  m = (Map *)malloc(sizeof(*m));
+
+  gettimeofday(&start, NULL);
+  for (i = 0; i < n; i++)
+  {
+    rng_derive(&r, world.seed, i, 0, stream_terrain);
+    smooth_height(m, &r);
+    map_terrain(m, &r, 3 + rng_below(&r, MAP_X - 6),
+                3 + rng_below(&r, MAP_X - 6), 3 + rng_below(&r, MAP_Y - 6),
+                3 + rng_below(&r, MAP_Y - 6));
+    place_boulders(m, &r);
+    place_trees(m, &r);
+    build_paths(m);
+  }
+  gettimeofday(&end, NULL);
+
+  secs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+  printf("%d maps in %.3fs, %.1f us/map (%s)\n", n, secs, secs / n * 1e6,
+#ifdef POKE327_LIBC_RAND
+         "libc rand"
+#else
+         "xoshiro256**"
+#endif
+  );
+
+  free(m);
+}
+
 int main(int argc, char *argv[])
 {
   struct timeval tv;
@@ -1308,11 +1360,25 @@ int main(int argc, char *argv[])
   }
 
   printf("Using seed: %u\n", seed);
-  srand(seed);
+  world.seed = seed;
+  game_seed(seed);
 
-  io_init_terminal();
+  if (getenv("POKE327_BENCH_TERRAIN"))
+  {
+    bench_terrain(atoi(getenv("POKE327_BENCH_TERRAIN")));
+    return 0;
+  }
 
-  db_parse(false);
+  // Nothing needs the database until the first pokemon, so load it
+  // while the terminal and the world are set up.
+  db_conf.watch = getenv("POKE327_WATCH_DB") != NULL;
+  if (getenv("POKE327_SHM_DB"))
+  {
+    db_conf.shm_name = getenv("POKE327_SHM_DB");
+  }
+  db_parse_async();
+
+  io_init_terminal();
 
   init_world();
 
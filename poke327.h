@@ -8,6 +8,7 @@
 #include <string>
 
 #include "heap.h"
+#include "rng.h"
 #include "character.h"
 #include "pokemon.h"
 
@@ -20,10 +21,10 @@
 /* Returns true if random float in [0,1] is less than *
  * numerator/denominator.  Uses only integer math.    */
 #define rand_under(numerator, denominator) \
-  (rand() < ((RAND_MAX / denominator) * numerator))
+  (game_rand() < ((RNG_MAX / denominator) * numerator))
 
 /* Returns random integer in [min, max]. */
-#define rand_range(min, max) ((rand() % (((max) + 1) - (min))) + (min))
+#define rand_range(min, max) (game_below(((max) + 1) - (min)) + (min))
 
 #define UNUSED(f) ((void)f)
 
@@ -130,9 +131,20 @@ public:
   Pokemon *pokemons[6];
 };
 
+/* Maps draw from streams of their own, derived from the seed, their *
+ * coordinates and one of these; see new_map().                       */
+enum map_stream
+{
+  stream_terrain,
+  stream_exit_ns,
+  stream_exit_ew,
+  stream_buildings
+};
+
 class World
 {
 public:
+  uint32_t seed;
   Map *world[WORLD_SIZE][WORLD_SIZE];
   pair_t cur_idx;
   Map *cur_map;
@@ -156,7 +168,7 @@ extern pair_t all_dirs[8];
 
 #define rand_dir(dir)         \
   {                           \
-    int _i = rand() & 0x7;    \
+    int _i = game_rand() & 0x7; \
     dir[0] = all_dirs[_i][0]; \
     dir[1] = all_dirs[_i][1]; \
   }
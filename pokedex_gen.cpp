@@ -0,0 +1,413 @@
+#include <cstdio>
+#include <cstdlib>
+#include <climits>
+#include <cstring>
+
+#include "db_parse.h"
+
+/* Loads the CSVs the usual way and writes every table back out as C++ *
+ * source, for builds with POKEDEX_BUILTIN.  The species are loaded    *
+ * with their movesets and base stats already built, so nothing in the *
+ * generated tables is ever written at run time and all of it can live *
+ * in .rodata.                                                          *
+ *                                                                      *
+ *   pokedex_gen <csv directory> <output file>                          */
+
+static void emit_str(FILE *o, const char *s)
+{
+  fputc('"', o);
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') {
+      fprintf(o, "\\%c", *s);
+    } else if (*s < ' ' || *s > '~') {
+      fprintf(o, "\\%03o", (unsigned char) *s);
+    } else {
+      fputc(*s, o);
+    }
+  }
+  fputc('"', o);
+}
+
+static void emit_pokemon(FILE *o)
+{
+  unsigned i;
+
+  fprintf(o, "static const pokemon_db builtin_pokemon[%u] = {\n",
+          num_pokemon + 1);
+  for (i = 0; i <= num_pokemon; i++) {
+    fprintf(o, "  { %d, %u, %d, %d, %d, %d, %d, %d },\n",
+            pokemon[i].id, pokemon[i].name, pokemon[i].species_id,
+            pokemon[i].height, pokemon[i].weight, pokemon[i].base_experience,
+            pokemon[i].order, pokemon[i].is_default);
+  }
+  fprintf(o, "};\n\n");
+}
+
+static void emit_moves(FILE *o)
+{
+  unsigned i;
+
+  fprintf(o, "static const move_db builtin_moves[%u] = {\n", num_moves + 1);
+  for (i = 0; i <= num_moves; i++) {
+    fprintf(o, "  { %d, %u, %d, %d, %d, %d, %d, %d },\n",
+            moves[i].id, moves[i].name, moves[i].type_id, moves[i].power,
+            moves[i].pp, moves[i].accuracy, moves[i].priority,
+            moves[i].damage_class_id);
+  }
+  fprintf(o, "};\n\n");
+
+  fprintf(o, "extern const move_cold_db builtin_moves_cold[%u] = {\n",
+          num_moves + 1);
+  for (i = 0; i <= num_moves; i++) {
+    const move_cold_db &m = move_cold(i);
+
+    fprintf(o, "  { %d, %d, %d, %d, %d, %d, %d },\n",
+            m.generation_id, m.target_id, m.effect_id, m.effect_chance,
+            m.contest_type_id, m.contest_effect_id,
+            m.super_contest_effect_id);
+  }
+  fprintf(o, "};\n\n");
+}
+
+static void emit_pokemon_moves(FILE *o)
+{
+  unsigned i;
+
+  fprintf(o, "static const pokemon_move_db builtin_pokemon_moves[%u] = {\n",
+          num_pokemon_moves + 1);
+  for (i = 0; i <= num_pokemon_moves; i++) {
+    fprintf(o, "  { %d, %d, %d, %d, %d, %d },\n",
+            pokemon_moves[i].pokemon_id, pokemon_moves[i].version_group_id,
+            pokemon_moves[i].move_id, pokemon_moves[i].pokemon_move_method_id,
+            pokemon_moves[i].level, pokemon_moves[i].order);
+  }
+  fprintf(o, "};\n\n");
+}
+
+static void emit_levelup(FILE *o, const char *name, const levelup_move *l,
+                         unsigned n)
+{
+  unsigned i;
+
+  // One spare row, so that an empty table is still a legal array
+  fprintf(o, "static const levelup_move %s[%u] = {\n", name, n + 1);
+  for (i = 0; i < n; i++) {
+    fprintf(o, "  { %d, %d },\n", l[i].level, l[i].move);
+  }
+  fprintf(o, "};\n\n");
+}
+
+static void emit_species(FILE *o)
+{
+  const pokemon_species_db *s;
+  unsigned i, n;
+
+  for (n = 0, i = 1; i <= num_species; i++) {
+    if (species[i].levelup_offset + species[i].num_levelup_moves > n) {
+      n = species[i].levelup_offset + species[i].num_levelup_moves;
+    }
+  }
+  emit_levelup(o, "builtin_levelup_moves", levelup_moves, n);
+
+  fprintf(o, "static const pokemon_species_db builtin_species[%u] = {\n",
+          num_species + 1);
+  for (i = 0; i <= num_species; i++) {
+    s = species + i;
+    fprintf(o, "  { %d, %u, %d, %d, %d, %d, %d, %d, %s, %u, %u, "
+            "{ %d, %d, %d, %d, %d, %d }, { %u, %u } },\n",
+            s->id, s->name, s->evolves_from_species_id,
+            s->evolution_chain_id, s->habitat_id, s->gender_rate,
+            s->capture_rate,
+            s->growth_rate_id, s->initialized ? "true" : "false",
+            s->levelup_offset, s->num_levelup_moves,
+            s->base_stat[0], s->base_stat[1], s->base_stat[2],
+            s->base_stat[3], s->base_stat[4], s->base_stat[5],
+            s->type[0], s->type[1]);
+  }
+  fprintf(o, "};\n\n");
+
+  fprintf(o, "extern const pokemon_species_cold_db "
+          "builtin_species_cold[%u] = {\n", num_species + 1);
+  for (i = 0; i <= num_species; i++) {
+    const pokemon_species_cold_db &c = species_cold(i);
+
+    fprintf(o, "  { %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d },\n",
+            c.generation_id, c.color_id, c.shape_id, c.base_happiness,
+            c.is_baby, c.hatch_counter, c.has_gender_differences,
+            c.forms_switchable, c.is_legendary, c.is_mythical, c.order,
+            c.conquest_order);
+  }
+  fprintf(o, "};\n\n");
+}
+
+static void emit_experience(FILE *o)
+{
+  unsigned i;
+
+  fprintf(o, "static const experience_db builtin_experience[%u] = {\n",
+          num_experience + 1);
+  for (i = 0; i <= num_experience; i++) {
+    fprintf(o, "  { %d, %d, %d },\n", experience[i].growth_rate_id,
+            experience[i].level, experience[i].experience);
+  }
+  fprintf(o, "};\n\n");
+}
+
+static void emit_experience_curve(FILE *o)
+{
+  unsigned i;
+  int l;
+
+  fprintf(o, "static const int builtin_experience_curve[%u][%d] = {\n",
+          num_growth_rates + 1, DB_CURVE_LEVELS);
+  for (i = 0; i <= num_growth_rates; i++) {
+    fprintf(o, "  {");
+    for (l = 0; l < DB_CURVE_LEVELS; l++) {
+      if (experience_curve[i][l] == INT_MAX) {
+        fprintf(o, "%s INT_MAX,", l % 8 ? "" : "\n   ");
+      } else {
+        fprintf(o, "%s %d,", l % 8 ? "" : "\n   ", experience_curve[i][l]);
+      }
+    }
+    fprintf(o, "\n  },\n");
+  }
+  fprintf(o, "};\n\n");
+}
+
+static void emit_pokemon_stats(FILE *o)
+{
+  unsigned i;
+
+  fprintf(o, "static const pokemon_stats_db builtin_pokemon_stats[%u] = {\n",
+          num_pokemon_stats + 1);
+  for (i = 0; i <= num_pokemon_stats; i++) {
+    fprintf(o, "  { %d, %d, %d, %d },\n", pokemon_stats[i].pokemon_id,
+            pokemon_stats[i].stat_id, pokemon_stats[i].base_stat,
+            pokemon_stats[i].effort);
+  }
+  fprintf(o, "};\n\n");
+}
+
+static void emit_pokemon_types(FILE *o)
+{
+  unsigned i;
+
+  fprintf(o, "static const pokemon_type_db builtin_pokemon_types[%u] = {\n",
+          num_pokemon_types + 1);
+  for (i = 0; i <= num_pokemon_types; i++) {
+    fprintf(o, "  { %d, %d, %d },\n", pokemon_types[i].pokemon_id,
+            pokemon_types[i].type_id, pokemon_types[i].slot);
+  }
+  fprintf(o, "};\n\n");
+}
+
+static void emit_type_efficacy(FILE *o)
+{
+  unsigned i, j;
+
+  fprintf(o, "static const uint8_t builtin_type_efficacy[%d][%d] = {\n",
+          DB_NUM_TYPES + 1, DB_NUM_TYPES + 1);
+  for (i = 0; i <= DB_NUM_TYPES; i++) {
+    fprintf(o, "  {");
+    for (j = 0; j <= DB_NUM_TYPES; j++) {
+      fprintf(o, " %u,", type_efficacy[i][j]);
+    }
+    fprintf(o, " },\n");
+  }
+  fprintf(o, "};\n\n");
+}
+
+static void emit_pokemon_evolutions(FILE *o)
+{
+  unsigned i;
+
+  fprintf(o, "static const pokemon_evolution_db "
+          "builtin_pokemon_evolutions[%u] = {\n", num_pokemon_evolutions + 1);
+  for (i = 0; i <= num_pokemon_evolutions; i++) {
+    fprintf(o, "  { %d, %d, %d, %d },\n", pokemon_evolutions[i].id,
+            pokemon_evolutions[i].evolved_species_id,
+            pokemon_evolutions[i].evolution_trigger_id,
+            pokemon_evolutions[i].minimum_level);
+  }
+  fprintf(o, "};\n\n");
+}
+
+static void emit_evolution_index(FILE *o)
+{
+  const evolution_index *x = &evolution_idx;
+  unsigned i, n = x->chain_offsets[x->num_chains + 1];
+
+  fprintf(o, "static const unsigned builtin_chain_offsets[%u] = {\n",
+          x->num_chains + 2);
+  for (i = 0; i < x->num_chains + 2; i++) {
+    fprintf(o, "  %u,\n", x->chain_offsets[i]);
+  }
+  fprintf(o, "};\n\n");
+
+  // One spare entry, so that an empty order is still a legal array
+  fprintf(o, "static const int builtin_evolution_order[%u] = {\n", n + 1);
+  for (i = 0; i < n; i++) {
+    fprintf(o, "  %d,\n", x->order[i]);
+  }
+  fprintf(o, "};\n\n");
+
+  fprintf(o, "static const species_evolution "
+          "builtin_species_evolution[%u] = {\n", num_species + 1);
+  for (i = 0; i <= num_species; i++) {
+    fprintf(o, "  { %u, %u, %d },\n", x->species[i].first_child,
+            x->species[i].num_children, x->species[i].evolution_level);
+  }
+  fprintf(o, "};\n\n");
+}
+
+static void emit_types(FILE *o)
+{
+  unsigned i;
+
+  fprintf(o, "static const unsigned builtin_types[%u] = {\n", num_types + 1);
+  for (i = 0; i <= num_types; i++) {
+    fprintf(o, "  %u,\n", types[i]);
+  }
+  fprintf(o, "};\n\n");
+}
+
+// Every interned identifier, at the same offsets as in db_strings
+static void emit_strings(FILE *o)
+{
+  unsigned i, end;
+
+  auto grow = [&](unsigned name) {
+    if (name + strlen(db_strings + name) + 1 > end) {
+      end = name + strlen(db_strings + name) + 1;
+    }
+  };
+
+  for (end = 1, i = 1; i <= num_pokemon; i++) {
+    grow(pokemon[i].name);
+  }
+  for (i = 1; i <= num_moves; i++) {
+    grow(moves[i].name);
+  }
+  for (i = 1; i <= num_species; i++) {
+    grow(species[i].name);
+  }
+  for (i = 1; i <= num_types; i++) {
+    grow(types[i]);
+  }
+
+  fprintf(o, "static const char builtin_db_strings[] =\n");
+  for (i = 0; i < end; i += strlen(db_strings + i) + 1) {
+    fprintf(o, "  ");
+    emit_str(o, db_strings + i);
+    fprintf(o, " \"\\0\"\n");
+  }
+  fprintf(o, "  ;\n\n");
+}
+
+static void emit_index(FILE *o)
+{
+  const pokemon_move_index *x = &pokemon_move_idx;
+  unsigned i, k;
+
+  k = x->num_pokemon * x->num_methods;
+  fprintf(o, "static const unsigned builtin_move_offsets[%u] = {\n", k + 1);
+  for (i = 0; i <= k; i++) {
+    fprintf(o, "  %u,\n", x->offsets[i]);
+  }
+  fprintf(o, "};\n\n");
+  emit_levelup(o, "builtin_index_moves", x->moves, x->offsets[k]);
+}
+
+// The globals from db_parse.h, pointing into the tables above
+static void emit_globals(FILE *o)
+{
+#define GLOBAL(type, table)                                             \
+  fprintf(o, "%s *" #table " = const_cast<%s *>(builtin_" #table ");\n" \
+          "unsigned num_" #table " = %u;\n", type, type, num_##table)
+
+  GLOBAL("pokemon_db", pokemon);
+  GLOBAL("move_db", moves);
+  GLOBAL("pokemon_move_db", pokemon_moves);
+  GLOBAL("pokemon_species_db", species);
+  GLOBAL("experience_db", experience);
+  GLOBAL("pokemon_stats_db", pokemon_stats);
+  GLOBAL("unsigned", types);
+  GLOBAL("pokemon_type_db", pokemon_types);
+  GLOBAL("pokemon_evolution_db", pokemon_evolutions);
+
+#undef GLOBAL
+
+  fprintf(o, "char *db_strings = const_cast<char *>(builtin_db_strings);\n");
+  fprintf(o, "uint8_t (*type_efficacy)[DB_NUM_TYPES + 1] =\n"
+          "  const_cast<uint8_t (*)[DB_NUM_TYPES + 1]>"
+          "(builtin_type_efficacy);\n");
+  fprintf(o, "int (*experience_curve)[DB_CURVE_LEVELS] =\n"
+          "  const_cast<int (*)[DB_CURVE_LEVELS]>(builtin_experience_curve);\n"
+          "unsigned num_growth_rates = %u;\n", num_growth_rates);
+  fprintf(o, "levelup_move *levelup_moves =\n"
+          "  const_cast<levelup_move *>(builtin_levelup_moves);\n"
+          "pokemon_move_index pokemon_move_idx = {\n"
+          "  %d, %d,\n"
+          "  const_cast<unsigned *>(builtin_move_offsets),\n"
+          "  const_cast<levelup_move *>(builtin_index_moves)\n"
+          "};\n",
+          pokemon_move_idx.num_pokemon, pokemon_move_idx.num_methods);
+  fprintf(o, "evolution_index evolution_idx = {\n"
+          "  %u,\n"
+          "  const_cast<unsigned *>(builtin_chain_offsets),\n"
+          "  const_cast<int *>(builtin_evolution_order),\n"
+          "  const_cast<species_evolution *>(builtin_species_evolution)\n"
+          "};\n", evolution_idx.num_chains);
+}
+
+int main(int argc, char *argv[])
+{
+  FILE *o;
+
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s <csv directory> <output file>\n", argv[0]);
+    return 1;
+  }
+
+  /* Straight from the CSVs: a snapshot or shared segment left by some *
+   * other build could be stale, and nothing here should outlive the   *
+   * run or leave anything behind for the next one.                   */
+  db_conf.csv_dir = argv[1];
+  db_conf.precompute = true;
+  db_conf.snapshot = false;
+  db_conf.watch = false;
+  db_conf.shm_name.clear();
+  db_parse(false);
+
+  if (!(o = fopen(argv[2], "w"))) {
+    perror(argv[2]);
+    return 1;
+  }
+
+  fprintf(o, "// Generated by pokedex_gen from %s; do not edit.\n\n"
+          "#include <cstddef>\n"
+          "#include <climits>\n\n"
+          "#include \"db_parse.h\"\n\n", argv[1]);
+  emit_pokemon(o);
+  emit_moves(o);
+  emit_pokemon_moves(o);
+  emit_species(o);
+  emit_experience(o);
+  emit_experience_curve(o);
+  emit_pokemon_stats(o);
+  emit_pokemon_types(o);
+  emit_type_efficacy(o);
+  emit_pokemon_evolutions(o);
+  emit_types(o);
+  emit_strings(o);
+  emit_index(o);
+  emit_evolution_index(o);
+  emit_globals(o);
+
+  if (fclose(o)) {
+    perror(argv[2]);
+    return 1;
+  }
+
+  return 0;
+}
@@ -1,4 +1,6 @@
 #include <cstdlib>
+#include <climits>
+#include <new>
 #include <algorithm>
 #include <stdlib.h>
 #include <math.h>
@@ -7,112 +9,335 @@
 #include "pokemon.h"
 #include "db_parse.h"
 
-static int compare_move(const void *v1, const void *v2)
+// Species i, with its moveset and base stats built
+static const pokemon_species_db *ready_species(int i)
 {
-  return ((levelup_move *)v1)->level - ((levelup_move *)v2)->level;
+  if (!db_species_ready(i))
+  {
+    // We have never generated a pokemon of this species before, and it
+    // wasn't precomputed at load time, so build its level-up moveset and
+    // base stats now.
+    db_init_species(i);
+  }
+
+  return species + i;
 }
 
 Pokemon::Pokemon(int level) : level(level)
 {
-  pokemon_species_db *s;
-  unsigned i, j;
-  bool found;
+  db_wait();
+
+  // Add 1 because array is 1-indexed
+  pokemon_species_index = game_below(num_species) + 1;
+  roll(&game_rng);
+}
+
+Pokemon::Pokemon(int species_id, int level, rng *r) : level(level)
+{
+  db_wait();
 
-  // Subtract 1 because array is 1-indexed
-  pokemon_species_index = rand() % ((sizeof(species) /
-                                     sizeof(species[0])) -
-                                    1);
-  s = species + pokemon_species_index;
+  pokemon_species_index = species_id;
+  roll(r);
+}
 
-  if (!s->levelup_moves)
+// Everything but the species and level, drawn from r
+void Pokemon::roll(rng *r)
+{
+  const pokemon_species_db *s = ready_species(pokemon_species_index);
+  unsigned i;
+
+  pick_moves(s, r);
+
+  // Calculate IVs
+  for (i = 0; i < 6; i++)
   {
-    // We have never generated a pokemon of this species before, so we
-    // need to find it's level-up moveset and save it for next time.
-    for (s->num_levelup_moves = 0, i = 1;
-         i < (sizeof(pokemon_moves) / sizeof(pokemon_moves[0]));
-         i++)
-    {
-      if (s->id == pokemon_moves[i].pokemon_id &&
-          pokemon_moves[i].pokemon_move_method_id == 1)
-      {
-        for (found = false, j = 0; !found && j < s->num_levelup_moves; j++)
-        {
-          if (s->levelup_moves[j].move == pokemon_moves[i].move_id)
-          {
-            found = true;
-          }
-        }
-        if (!found)
-        {
-          s->num_levelup_moves++;
-          s->levelup_moves = ((levelup_move *)
-                                  realloc(s->levelup_moves,
-                                          (s->num_levelup_moves *
-                                           sizeof(*s->levelup_moves))));
-          s->levelup_moves[s->num_levelup_moves - 1].level =
-              pokemon_moves[i].level;
-          s->levelup_moves[s->num_levelup_moves - 1].move =
-              pokemon_moves[i].move_id;
-        }
-      }
-    }
-    // s->levelup_moves now contains all of the moves this species can learn
-    // through leveling up.  Now we'll sort it by level to make that process
-    // simpler.
-    qsort(s->levelup_moves, s->num_levelup_moves,
-          sizeof(*s->levelup_moves), compare_move);
-
-    // Also initialize base stats while we're here
-    s->base_stat[0] = pokemon_stats[pokemon_species_index * 6 - 5].base_stat;
-    s->base_stat[1] = pokemon_stats[pokemon_species_index * 6 - 4].base_stat;
-    s->base_stat[2] = pokemon_stats[pokemon_species_index * 6 - 3].base_stat;
-    s->base_stat[3] = pokemon_stats[pokemon_species_index * 6 - 2].base_stat;
-    s->base_stat[4] = pokemon_stats[pokemon_species_index * 6 - 1].base_stat;
-    s->base_stat[5] = pokemon_stats[pokemon_species_index * 6 - 0].base_stat;
+    IV[i] = rng_int(r) & 0xf;
   }
+  compute_stats();
+
+  shiny = ((rng_int(r) & 0x1fff) ? false : true);
+  gender = ((rng_int(r) & 0x1fff) ? gender_female : gender_male);
+
+  hp = effective_stat[stat_hp];
+
+  init_experience(s);
+}
 
-  // Get pokemon's move(s).
-  for (i = 0;
-       i < s->num_levelup_moves && s->levelup_moves[i].level <= level;
-       i++)
-    ;
+void Pokemon::pick_moves(const pokemon_species_db *s, rng *r)
+{
+  const levelup_move *l = s->levelup();
+  unsigned i, j;
+
+  // Get pokemon's move(s): the ones learned by now, since l is sorted by
+  // level
+  i = std::upper_bound(l, l + s->num_levelup_moves, level,
+                       [](int level, const levelup_move &m) {
+                         return level < m.level;
+                       }) - l;
 
   // 0 is an invalid index, since the array is 1 indexed.
   move_index[0] = move_index[1] = move_index[2] = move_index[3] = 0;
   // I don't think 0 moves is possible, but account for it to be safe
   if (i)
   {
-    move_index[0] = s->levelup_moves[rand() % i].move;
+    move_index[0] = l[rng_below(r, i)].move;
     if (i != 1)
     {
       do
       {
-        j = rand() % i;
-      } while (s->levelup_moves[j].move == move_index[0]);
-      move_index[1] = s->levelup_moves[j].move;
+        j = rng_below(r, i);
+      } while (l[j].move == move_index[0]);
+      move_index[1] = l[j].move;
     }
   }
+}
+
+void Pokemon::init_experience(const pokemon_species_db *s)
+{
+  experience = 0;
+  if (s->growth_rate_id > 0 && (unsigned)s->growth_rate_id <= num_growth_rates)
+  {
+    experience = experience_for_level(s->growth_rate_id, level);
+  }
+}
+
+// Pokemon generated per pass; every buffer for a pass fits in L1
+#define POKEMON_BATCH 256
+
+void generate_pokemon_batch(int min_level, int max_level, unsigned count,
+                            rng *r, Pokemon *out)
+{
+  int species_id[POKEMON_BATCH], level[POKEMON_BATCH] = { 0 };
+  int iv[6][POKEMON_BATCH] = { { 0 } }, base[6][POKEMON_BATCH] = { { 0 } };
+  int stat[6][POKEMON_BATCH];
+  const pokemon_species_db *s;
+  unsigned n, m, i, k;
+  Pokemon *p;
+
+  db_wait();
+
+  for (n = 0; n < count; n += m)
+  {
+    m = std::min(count - n, (unsigned)POKEMON_BATCH);
+
+    for (i = 0; i < m; i++)
+    {
+      species_id[i] = rng_below(r, num_species) + 1;
+      level[i] = rng_below(r, max_level - min_level + 1) + min_level;
+    }
+    for (k = 0; k < 6; k++)
+    {
+      for (i = 0; i < m; i++)
+      {
+        iv[k][i] = rng_int(r) & 0xf;
+      }
+    }
+
+    // Gather the base stats, so that the stat loops are pure arithmetic
+    for (i = 0; i < m; i++)
+    {
+      s = ready_species(species_id[i]);
+      for (k = 0; k < 6; k++)
+      {
+        base[k][i] = s->base_stat[k];
+      }
+    }
+
+    // Whole blocks, even past m, so the trip counts are constant
+    for (k = 0; k < 6; k++)
+    {
+      for (i = 0; i < POKEMON_BATCH; i++)
+      {
+        stat[k][i] = 5 + ((base[k][i] + iv[k][i]) * 2 * level[i]) / 100;
+      }
+    }
+    for (i = 0; i < POKEMON_BATCH; i++)
+    {
+      stat[stat_hp][i] += 5 + level[i];
+    }
+
+    for (i = 0; i < m; i++)
+    {
+      p = out + n + i;
+      s = species + species_id[i];
+      p->level = level[i];
+      p->pokemon_species_index = species_id[i];
+      for (k = 0; k < 6; k++)
+      {
+        p->IV[k] = iv[k][i];
+        p->effective_stat[k] = stat[k][i];
+      }
+      p->hp = stat[stat_hp][i];
+      p->pick_moves(s, r);
+      p->shiny = ((rng_int(r) & 0x1fff) ? false : true);
+      p->gender = ((rng_int(r) & 0x1fff) ? gender_female : gender_male);
+      p->init_experience(s);
+    }
+  }
+}
+
+void Pokemon::compute_stats()
+{
+  pokemon_species_db *s = species + pokemon_species_index;
+  unsigned i;
 
-  // Calculate IVs
   for (i = 0; i < 6; i++)
   {
-    IV[i] = rand() & 0xf;
     effective_stat[i] = 5 + ((s->base_stat[i] + IV[i]) * 2 * level) / 100;
     if (i == 0)
     { // HP
       effective_stat[i] += 5 + level;
     }
   }
+}
+
+int Pokemon::get_level() const
+{
+  return level;
+}
 
-  shiny = ((rand() & 0x1fff) ? false : true);
-  gender = ((rand() & 0x1fff) ? gender_female : gender_male);
+int Pokemon::get_experience() const
+{
+  return experience;
+}
 
-  hp = effective_stat[stat_hp];
+int Pokemon::experience_yield() const
+{
+  // Default forms share their species' id
+  return pokemon[pokemon_species_index].base_experience * level / 7;
+}
+
+int Pokemon::gain_experience(int xp)
+{
+  int g = species[pokemon_species_index].growth_rate_id;
+  int old_level = level;
+  int old_hp = effective_stat[stat_hp];
+  int l;
+
+  if (g <= 0 || (unsigned)g > num_growth_rates || xp <= 0)
+  {
+    return 0;
+  }
+
+  // Past the last level the curve is INT_MAX, so stop just short of it
+  experience = xp < INT_MAX - 1 - experience ? experience + xp : INT_MAX - 1;
+  if ((l = level_for_experience(g, experience)) > level)
+  {
+    level = l;
+    compute_stats();
+    hp += effective_stat[stat_hp] - old_hp;
+  }
+
+  return level - old_level;
+}
+
+// Becomes species_id, keeping its level, IVs and the damage it has taken
+void Pokemon::evolve(int species_id)
+{
+  int old_hp = effective_stat[stat_hp];
+
+  pokemon_species_index = species_id;
+  ready_species(species_id);
+  compute_stats();
+  hp = std::max(hp + effective_stat[stat_hp] - old_hp, 0);
+}
+
+// Returns false if it already knows move; fills an empty slot if any
+bool Pokemon::learn(int move)
+{
+  unsigned i;
+
+  for (i = 0; i < 4; i++)
+  {
+    if (move_index[i] == move)
+    {
+      return false;
+    }
+  }
+  for (i = 0; i < 4; i++)
+  {
+    if (!move_index[i])
+    {
+      move_index[i] = move;
+      break;
+    }
+  }
+
+  return true;
+}
+
+void level_up_batch(Pokemon *const *party, const int *xp, unsigned n,
+                    level_up_result *out, std::vector<int> *new_moves)
+{
+  const pokemon_species_db *s;
+  const levelup_move *l, *end;
+  const species_evolution *e;
+  unsigned i, k;
+  int old_level, child, c, at;
+  Pokemon *p;
+
+  // The first move in [l, end) learned past level
+  auto after = [](const levelup_move *l, const levelup_move *end,
+                  int level) {
+    return std::upper_bound(l, end, level,
+                            [](int level, const levelup_move &m) {
+                              return level < m.level;
+                            });
+  };
+
+  for (i = 0; i < n; i++)
+  {
+    p = party[i];
+    old_level = p->level;
+    out[i].levels = p->gain_experience(xp[i]);
+    out[i].evolved_from = 0;
+
+    // The species a stage evolves into sit side by side in its chain
+    while (out[i].levels)
+    {
+      e = evolution_idx.species + p->pokemon_species_index;
+      for (child = 0, k = 0; k < e->num_children && !child; k++)
+      {
+        c = evolution_idx.order[e->first_child + k];
+        at = evolution_idx.species[c].evolution_level;
+        if (at && at <= p->level)
+        {
+          child = c;
+        }
+      }
+      if (!child)
+      {
+        break;
+      }
+      if (!out[i].evolved_from)
+      {
+        out[i].evolved_from = p->pokemon_species_index;
+      }
+      p->evolve(child);
+    }
+
+    // Moves learned after the old level, up to and including the new one
+    s = species + p->pokemon_species_index;
+    end = s->levelup() + s->num_levelup_moves;
+    out[i].first_move = new_moves->size();
+    if (out[i].levels)
+    {
+      l = after(s->levelup(), end, old_level);
+      for (end = after(l, end, p->level); l < end; l++)
+      {
+        if (p->learn(l->move))
+        {
+          new_moves->push_back(l->move);
+        }
+      }
+    }
+    out[i].num_moves = new_moves->size() - out[i].first_move;
+  }
 }
 
 const char *Pokemon::get_species() const
 {
-  return species[pokemon_species_index].identifier;
+  return species[pokemon_species_index].identifier();
 }
 
 int Pokemon::get_hp() const
@@ -162,11 +387,16 @@ void Pokemon::set_hp(int hpchg)
     hp = 0;
 }
 
+bool Pokemon::has_move(int i) const
+{
+  return i < 4 && move_index[i];
+}
+
 const char *Pokemon::get_move(int i) const
 {
   if (i < 4 && move_index[i])
   {
-    return moves[move_index[i]].identifier;
+    return moves[move_index[i]].identifier();
   }
   else
   {
@@ -204,25 +434,25 @@ std::ostream &Pokemon::print(std::ostream &o) const
   o << "  Levelup moves: " << std::endl;
   for (i = 0; i < s->num_levelup_moves; i++)
   {
-    o << "    " << moves[s->levelup_moves[i].move].identifier
-      << ":" << s->levelup_moves[i].level << std::endl;
+    o << "    " << moves[s->levelup()[i].move].identifier()
+      << ":" << s->levelup()[i].level << std::endl;
   }
   o << "  Known moves: " << std::endl;
   if (move_index[0])
   {
-    o << "    " << moves[move_index[0]].identifier << std::endl;
+    o << "    " << moves[move_index[0]].identifier() << std::endl;
   }
   if (move_index[1])
   {
-    o << "    " << moves[move_index[1]].identifier << std::endl;
+    o << "    " << moves[move_index[1]].identifier() << std::endl;
   }
   if (move_index[2])
   {
-    o << "    " << moves[move_index[2]].identifier << std::endl;
+    o << "    " << moves[move_index[2]].identifier() << std::endl;
   }
   if (move_index[3])
   {
-    o << "    " << moves[move_index[3]].identifier << std::endl;
+    o << "    " << moves[move_index[3]].identifier() << std::endl;
   }
 
   return o;
@@ -233,25 +463,261 @@ std::ostream &operator<<(std::ostream &o, const Pokemon &p)
   return p.print(o);
 }
 
-int Pokemon::get_dam(int moveIdx, int rand)
+static thread_local pokemon_slab *free_slabs;
+
+Pokemon_arena::Pokemon_arena() : slabs(NULL)
+{
+}
+
+Pokemon_arena::~Pokemon_arena()
+{
+  release();
+}
+
+// Room for one more Pokemon, in a new slab if the last one is full
+void *Pokemon_arena::alloc()
+{
+  pokemon_slab *s;
+
+  if (!slabs || slabs->used == POKEMON_SLAB_SIZE)
+  {
+    if ((s = free_slabs))
+    {
+      free_slabs = s->next;
+    }
+    else
+    {
+      s = new pokemon_slab;
+    }
+    s->used = 0;
+    s->next = slabs;
+    slabs = s;
+  }
+
+  return slabs->storage[slabs->used++];
+}
+
+Pokemon *Pokemon_arena::make(int level)
+{
+  return new (alloc()) Pokemon(level);
+}
+
+Pokemon *Pokemon_arena::make(int species_id, int level, rng *r)
+{
+  return new (alloc()) Pokemon(species_id, level, r);
+}
+
+void Pokemon_arena::release()
 {
-  int crit = 1;
-  int type = 1;
-  int STAB = 1;
+  pokemon_slab *s;
+  unsigned i;
 
-  int power = moves[move_index[moveIdx]].power;
-  if (power < 1)
+  while ((s = slabs))
   {
-    power = 1;
+    for (i = 0; i < s->used; i++)
+    {
+      ((Pokemon *)s->storage[i])->~Pokemon();
+    }
+    slabs = s->next;
+    s->next = free_slabs;
+    free_slabs = s;
   }
+}
 
-  double damage = (double)((double)(((double)((2 * level) / 5) + 2) * power * ((double)(effective_stat[stat_atk] / effective_stat[stat_def]) / 50)) + 2) *
-                  crit * (double)(rand / 100) * STAB * type;
+/* The damage formula with its 1/50, STAB's 3/2 and the type's 1/10000 *
+ * multiplied out, so that every step is exact integer arithmetic and  *
+ * the SIMD kernels below can match it bit for bit.  stab is in halves *
+ * and type in 1/10000ths.  Every hit does at least 1, except on a     *
+ * defender that is immune to the type, which takes none.              */
+#define DAMAGE_SCALE (50 * 2 * 10000)
 
-  if (damage == 0)
-    damage = 1;
+static int damage_formula(int level, int power, int atk, int def, int roll,
+                          int stab, int type)
+{
+  int64_t n = ((int64_t)((2 * level) / 5 + 2) * power * (atk / def) + 100) *
+              (roll / 100) * stab * type;
+
+  return (int)std::max<int64_t>(type != 0,
+                                (n + DAMAGE_SCALE - 1) / DAMAGE_SCALE);
+}
 
-  return (int)ceil(damage);
+// The terms of the damage formula that depend on the move and defender
+void Pokemon::damage_terms(int moveIdx, const Pokemon *defender, int *power,
+                           int *stab, int *type) const
+{
+  const move_db *m = moves + move_index[moveIdx];
+  const uint8_t *own = species[pokemon_species_index].type;
+  // Types past the matrix count as no type at all
+  int t = (unsigned)m->type_id <= DB_NUM_TYPES ? m->type_id : 0;
+
+  *power = std::max(m->power, 1);
+  // Same-type attack bonus, without a branch
+  *stab = 2 + ((t != 0) & ((t == own[0]) | (t == own[1])));
+  *type = type_multiplier(t, species[defender->pokemon_species_index].type);
+}
+
+int Pokemon::get_dam(int moveIdx, int rand, const Pokemon *defender)
+{
+  int power, stab, type;
+
+  damage_terms(moveIdx, defender, &power, &stab, &type);
+
+  return damage_formula(level, power, effective_stat[stat_atk],
+                        effective_stat[stat_def], rand, stab, type);
+}
+
+// The inputs to damage_formula() for a block of attacks, by column
+struct damage_block
+{
+  alignas(32) int level[POKEMON_BATCH];
+  alignas(32) int power[POKEMON_BATCH];
+  alignas(32) int atk[POKEMON_BATCH];
+  alignas(32) int def[POKEMON_BATCH];
+  alignas(32) int roll[POKEMON_BATCH];
+  alignas(32) int stab[POKEMON_BATCH];
+  alignas(32) int type[POKEMON_BATCH];
+};
+
+/* Damage for the first n attacks of a block.  Picked once at startup *
+ * from the best the CPU supports.                                    */
+typedef void (*damage_kernel_func)(const damage_block *b, unsigned n,
+                                   int *out);
+
+static void damage_rows(const damage_block *b, unsigned i, unsigned n,
+                        int *out)
+{
+  for (; i < n; i++)
+  {
+    out[i] = damage_formula(b->level[i], b->power[i], b->atk[i], b->def[i],
+                            b->roll[i], b->stab[i], b->type[i]);
+  }
+}
+
+static void damage_scalar(const damage_block *b, unsigned n, int *out)
+{
+  damage_rows(b, 0, n, out);
+}
+
+/* The kernels work in doubles.  Every product is a whole number below *
+ * 2^53 and every quotient of whole numbers that small truncates or    *
+ * rounds up to the same whole number as in integers, so nothing is    *
+ * ever rounded, and fused multiply-adds couldn't change a thing.      */
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+__attribute__((target("sse2")))
+static void damage_sse2(const damage_block *b, unsigned n, int *out)
+{
+  const __m128d one = _mm_set1_pd(1), two = _mm_set1_pd(2);
+  const __m128d five = _mm_set1_pd(5), hundred = _mm_set1_pd(100);
+  const __m128d scale = _mm_set1_pd(DAMAGE_SCALE);
+  __m128d l, q, r, x, t;
+  unsigned i;
+
+#define LOAD(column) \
+  _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i *)(b->column + i)))
+#define TRUNC(v) _mm_cvtepi32_pd(_mm_cvttpd_epi32(v))
+
+  for (i = 0; i + 2 <= n; i += 2)
+  {
+    l = TRUNC(_mm_div_pd(_mm_mul_pd(LOAD(level), two), five));
+    q = TRUNC(_mm_div_pd(LOAD(atk), LOAD(def)));
+    r = TRUNC(_mm_div_pd(LOAD(roll), hundred));
+    x = _mm_mul_pd(_mm_mul_pd(_mm_add_pd(l, two), LOAD(power)), q);
+    x = _mm_mul_pd(_mm_mul_pd(_mm_add_pd(x, hundred), r), LOAD(stab));
+    x = _mm_div_pd(_mm_mul_pd(x, LOAD(type)), scale);
+    // No rounding instructions before SSE4.1, so round up by hand
+    t = TRUNC(x);
+    x = _mm_add_pd(t, _mm_and_pd(_mm_cmplt_pd(t, x), one));
+    // At least 1, or 0 against an immune defender
+    x = _mm_max_pd(x, _mm_min_pd(LOAD(type), one));
+    _mm_storel_epi64((__m128i *)(out + i), _mm_cvttpd_epi32(x));
+  }
+
+#undef TRUNC
+#undef LOAD
+
+  damage_rows(b, i, n, out);
+}
+
+__attribute__((target("avx2")))
+static void damage_avx2(const damage_block *b, unsigned n, int *out)
+{
+  const __m256d one = _mm256_set1_pd(1), two = _mm256_set1_pd(2);
+  const __m256d five = _mm256_set1_pd(5), hundred = _mm256_set1_pd(100);
+  const __m256d scale = _mm256_set1_pd(DAMAGE_SCALE);
+  __m256d l, q, r, x;
+  unsigned i;
+
+#define LOAD(column) \
+  _mm256_cvtepi32_pd(_mm_load_si128((const __m128i *)(b->column + i)))
+#define TRUNC(v) _mm256_round_pd(v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC)
+
+  for (i = 0; i + 4 <= n; i += 4)
+  {
+    l = TRUNC(_mm256_div_pd(_mm256_mul_pd(LOAD(level), two), five));
+    q = TRUNC(_mm256_div_pd(LOAD(atk), LOAD(def)));
+    r = TRUNC(_mm256_div_pd(LOAD(roll), hundred));
+    x = _mm256_mul_pd(_mm256_mul_pd(_mm256_add_pd(l, two), LOAD(power)), q);
+    x = _mm256_mul_pd(_mm256_mul_pd(_mm256_add_pd(x, hundred), r),
+                      LOAD(stab));
+    x = _mm256_div_pd(_mm256_mul_pd(x, LOAD(type)), scale);
+    x = _mm256_round_pd(x, _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC);
+    x = _mm256_max_pd(x, _mm256_min_pd(LOAD(type), one));
+    _mm_storeu_si128((__m128i *)(out + i), _mm256_cvttpd_epi32(x));
+  }
+
+#undef TRUNC
+#undef LOAD
+
+  damage_rows(b, i, n, out);
+}
+
+static damage_kernel_func damage_pick_kernel()
+{
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+  {
+    return damage_avx2;
+  }
+  if (__builtin_cpu_supports("sse2"))
+  {
+    return damage_sse2;
+  }
+  return damage_scalar;
+}
+#else
+static damage_kernel_func damage_pick_kernel()
+{
+  return damage_scalar;
+}
+#endif
+
+static const damage_kernel_func damage_kernel = damage_pick_kernel();
+
+void damage_batch(const damage_query *q, unsigned n, int *out)
+{
+  damage_block b;
+  const Pokemon *p;
+  unsigned done, m, i;
+
+  for (done = 0; done < n; done += m)
+  {
+    m = std::min(n - done, (unsigned)POKEMON_BATCH);
+
+    // Gather, so that the kernel is pure arithmetic
+    for (i = 0; i < m; i++)
+    {
+      p = q[done + i].attacker;
+      p->damage_terms(q[done + i].move, q[done + i].defender, b.power + i,
+                      b.stab + i, b.type + i);
+      b.level[i] = p->level;
+      b.atk[i] = p->effective_stat[stat_atk];
+      b.def[i] = p->effective_stat[stat_def];
+      b.roll[i] = q[done + i].roll;
+    }
+    damage_kernel(&b, m, out + done);
+  }
 }
 
 int Pokemon::get_acc(int moveIdx)
@@ -2,6 +2,13 @@
 #define POKEMON_H
 
 #include <iostream>
+#include <vector>
+
+#include "rng.h"
+
+struct pokemon_species_db;
+struct damage_query;
+struct level_up_result;
 
 enum pokemon_stat
 {
@@ -23,6 +30,7 @@ class Pokemon
 {
 private:
   int level;
+  int experience;
   int pokemon_index;
   int move_index[4];
   int pokemon_species_index;
@@ -31,10 +39,35 @@ private:
   int hp;
   bool shiny;
   pokemon_gender gender;
+  void compute_stats();
+  void roll(rng *r);
+  void pick_moves(const pokemon_species_db *s, rng *r);
+  void init_experience(const pokemon_species_db *s);
+  void damage_terms(int moveIdx, const Pokemon *defender, int *power,
+                    int *stab, int *type) const;
+  void evolve(int species_id);
+  bool learn(int move);
+
+  friend void generate_pokemon_batch(int min_level, int max_level,
+                                     unsigned count, rng *r, Pokemon *out);
+  friend void damage_batch(const damage_query *q, unsigned n, int *out);
+  friend void level_up_batch(Pokemon *const *party, const int *xp,
+                             unsigned n, level_up_result *out,
+                             std::vector<int> *new_moves);
 
 public:
+  // An empty Pokemon, for generate_pokemon_batch() or assignment to fill
+  Pokemon() {}
   Pokemon(int level);
+  // A pokemon of the given species, drawn from r instead of the game
+  Pokemon(int species_id, int level, rng *r);
   const char *get_species() const;
+  int get_level() const;
+  int get_experience() const;
+  // Experience for defeating this pokemon
+  int experience_yield() const;
+  // Adds xp and levels up to match; returns the number of levels gained
+  int gain_experience(int xp);
   int get_hp() const;
   int get_atk() const;
   int get_def() const;
@@ -42,14 +75,91 @@ public:
   int get_spdef() const;
   int get_speed() const;
   int get_acc(int moveIdx);
-  int get_dam(int moveIdx, int rand);
+  // Damage to defender, with type effectiveness and STAB
+  int get_dam(int moveIdx, int rand, const Pokemon *defender);
   void set_hp(int hpchg);
   const char *get_gender_string() const;
   bool is_shiny() const;
+  bool has_move(int i) const;
   const char *get_move(int i) const;
   std::ostream &print(std::ostream &o) const;
 };
 
 std::ostream &operator<<(std::ostream &o, const Pokemon &p);
 
+/* Fills out[0] through out[count - 1] with random Pokemon of levels in *
+ * [min_level, max_level], drawing from r.  They're distributed like    *
+ * Pokemon(level) constructions, but species, IVs and stats are drawn a *
+ * block at a time in loops over flat arrays, so the same seed gives    *
+ * different Pokemon than constructing them one by one would.           */
+void generate_pokemon_batch(int min_level, int max_level, unsigned count,
+                            rng *r, Pokemon *out);
+
+// One attack for damage_batch(), as get_dam() takes it
+struct damage_query
+{
+  const Pokemon *attacker;
+  const Pokemon *defender;
+  int move;
+  int roll;
+};
+
+/* Sets out[i] to q[i].attacker->get_dam(q[i].move, q[i].roll,          *
+ * q[i].defender) for each of the n attacks.  The inputs are gathered a *
+ * block at a time and the arithmetic is done several attacks at once  *
+ * in SIMD lanes, giving exactly what get_dam() would.                  */
+void damage_batch(const damage_query *q, unsigned n, int *out);
+
+// What level_up_batch() did to one pokemon
+struct level_up_result
+{
+  int levels;
+  // The species it evolved from, or 0 if it didn't evolve
+  int evolved_from;
+  // The moves it can newly learn are new_moves[first_move] on
+  unsigned first_move;
+  unsigned num_moves;
+};
+
+/* Gives party[i] xp[i] experience for each of the n pokemon.  Any that  *
+ * gained a level and reached the evolution level of a species it       *
+ * evolves into does so, through as many stages as it has reached.  The *
+ * moves its species learns at the levels it passed are found by binary *
+ * search in its sorted level-up moveset; those it doesn't know yet go   *
+ * onto new_moves, and into its empty move slots while there are any.   */
+void level_up_batch(Pokemon *const *party, const int *xp, unsigned n,
+                    level_up_result *out, std::vector<int> *new_moves);
+
+#define POKEMON_SLAB_SIZE 32
+
+/* Room for POKEMON_SLAB_SIZE Pokemon, handed out in order.  Empty *
+ * slabs are kept on a free list per thread and reused.            */
+struct pokemon_slab
+{
+  pokemon_slab *next;
+  unsigned used;
+  alignas(Pokemon) unsigned char storage[POKEMON_SLAB_SIZE][sizeof(Pokemon)];
+};
+
+/* Scratch space for Pokemon that don't outlive something, like the    *
+ * opponents in a battle.  make() builds a Pokemon in a slab, and       *
+ * release() or the destructor frees every one of them at once, so     *
+ * none is ever deleted on its own.  Anything that has to live on must *
+ * be copied out first.                                                 */
+class Pokemon_arena
+{
+private:
+  pokemon_slab *slabs;
+  void *alloc();
+
+public:
+  Pokemon_arena();
+  ~Pokemon_arena();
+  Pokemon_arena(const Pokemon_arena &) = delete;
+  Pokemon_arena &operator=(const Pokemon_arena &) = delete;
+  Pokemon *make(int level);
+  Pokemon *make(int species_id, int level, rng *r);
+  void release();
+};
+
 #endif
@@ -0,0 +1,3 @@
+#include "rng.h"
+
+rng game_rng;
@@ -0,0 +1,127 @@
+#ifndef RNG_H
+# define RNG_H
+
+# include <stdint.h>
+# include <stdlib.h>
+
+/* xoshiro256**, a small, fast generator with 256 bits of state.  Each *
+ * stream is a plain struct that the caller owns, so independent      *
+ * streams never disturb one another and everything inlines.  Building *
+ * with POKE327_LIBC_RAND swaps in libc's rand_r() behind the same     *
+ * interface, so the two can be compared.                              */
+
+// Uniform in [0, RNG_MAX], like rand()
+# define RNG_MAX 0x7fffffff
+
+// splitmix64's finalizer: a bijection that scatters every input bit
+static inline uint64_t rng_mix(uint64_t z)
+{
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+  return z ^ (z >> 31);
+}
+
+# ifdef POKE327_LIBC_RAND
+struct rng {
+  unsigned s;
+};
+
+static inline void rng_seed(rng *r, uint64_t seed)
+{
+  r->s = (unsigned) (seed ^ (seed >> 32));
+}
+
+static inline int rng_int(rng *r)
+{
+  return rand_r(&r->s) & RNG_MAX;
+}
+
+static inline int rng_below(rng *r, int n)
+{
+  return rng_int(r) % n;
+}
+# else
+struct rng {
+  uint64_t s[4];
+};
+
+static inline uint64_t rng_rotl(uint64_t x, int k)
+{
+  return (x << k) | (x >> (64 - k));
+}
+
+/* Expands seed into a full state with splitmix64, which never yields *
+ * the all-zero state xoshiro can't leave.                            */
+static inline void rng_seed(rng *r, uint64_t seed)
+{
+  int i;
+
+  for (i = 0; i < 4; i++) {
+    r->s[i] = rng_mix(seed += 0x9e3779b97f4a7c15ULL);
+  }
+}
+
+static inline uint64_t rng_next(rng *r)
+{
+  uint64_t result = rng_rotl(r->s[1] * 5, 7) * 9;
+  uint64_t t = r->s[1] << 17;
+
+  r->s[2] ^= r->s[0];
+  r->s[3] ^= r->s[1];
+  r->s[1] ^= r->s[2];
+  r->s[0] ^= r->s[3];
+  r->s[2] ^= t;
+  r->s[3] = rng_rotl(r->s[3], 45);
+
+  return result;
+}
+
+// The top bits are the best ones
+static inline int rng_int(rng *r)
+{
+  return (int) (rng_next(r) >> 33);
+}
+
+/* Uniform in [0, n) for n > 0, by multiplying rather than dividing. *
+ * Biased by at most n / 2^32, far less than rand() % n is.          */
+static inline int rng_below(rng *r, int n)
+{
+  return (int) (((rng_next(r) >> 32) * (uint32_t) n) >> 32);
+}
+# endif
+
+/* Seeds r with a stream of its own for one purpose at one (x, y), *
+ * derived from seed alone.  The same arguments always give the     *
+ * same stream, whatever else has been drawn before.                */
+static inline void rng_derive(rng *r, uint64_t seed, int32_t x, int32_t y,
+                              uint32_t purpose)
+{
+  uint64_t h;
+
+  h = rng_mix(seed + 0x9e3779b97f4a7c15ULL);
+  h = rng_mix(h ^ (uint32_t) x);
+  h = rng_mix(h ^ ((uint64_t) (uint32_t) y << 32));
+  rng_seed(r, rng_mix(h ^ purpose));
+}
+
+/* The game's own stream, for everything that happens as it's played, *
+ * seeded once in main().                                             */
+extern rng game_rng;
+
+static inline void game_seed(uint32_t seed)
+{
+  rng_seed(&game_rng, seed);
+}
+
+static inline int game_rand()
+{
+  return rng_int(&game_rng);
+}
+
+static inline int game_below(int n)
+{
+  return rng_below(&game_rng, n);
+}
+
+#endif